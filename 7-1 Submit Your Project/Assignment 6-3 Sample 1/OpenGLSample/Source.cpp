@@ -1,5 +1,9 @@
 #include <iostream>         // cout, cerr
 #include <cstdlib>          // EXIT_FAILURE
+#include <cstring>          // strcmp
+#include <chrono>           // steady_clock for the offline benchmarks
+#include <string>           // dump file names
+#include <thread>           // sleep while headless runs wait for textures, the render thread
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
 #define STB_IMAGE_IMPLEMENTATION
@@ -8,6 +12,29 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <learnOpengl/camera.h> // Camera class
+#include "uniform_cache.h" // Per-program uniform location cache
+#include "frame_uniforms.h" // Per-frame camera and light uniform block
+#include "gl_state.h" // Redundant GL state filter
+#include "instance_buffer.h" // Per-instance model matrices and colors
+#include "mesh_optimizer.h" // Vertex welding and vertex cache statistics
+#include "vertex_packing.h" // Octahedral normals and half-float texture coordinates
+#include "texture_loader.h" // Worker thread image decoding and staged texture uploads
+#include "offscreen_target.h" // Framebuffer object rendered to by headless runs
+#include "headless_context.h" // Surfaceless EGL context, no window or display server
+#include "frame_benchmark.h" // Frame time percentiles per stage
+#include "gpu_profiler.h" // GL_TIME_ELAPSED queries per render pass and the F1 overlay
+#include "trace.h" // TRACE_ZONE instrumentation, compiled in only with ENABLE_TRACE
+#include "fixed_timestep.h" // Fixed-rate simulation ticks with render interpolation
+#include "render_commands.h" // Frames recorded as command lists and replayed by the thread that owns the context
+#include "stream_buffer.h" // Persistently mapped, fenced ring for per-frame uploads
+#include "mesh_pool.h" // Shared vertex/index buffers for every mesh of a vertex format, indirect draw commands
+#include "culling.h" // Mesh bounds, frustum planes and the SSE batch culler
+#include "mesh_simplify.h" // Quadric-error LOD chains sharing one vertex buffer
+#include "meshlet.h" // Triangle clusters with bounding spheres and normal cones
+#include "bvh.h" // Hierarchy over the scene objects for picking and culling
+#include "occlusion.h" // CPU depth rasterizer hiding objects behind occluders
+#include "draw_queue.h" // Draws sorted by packed state and depth keys before they are recorded
+#include "light_clusters.h" // Lights binned into view-space froxels for clustered forward shading
 using namespace std; // Standard namespace
 #ifndef GLSL
 #define GLSL(Version, Source) "#version " #Version " core \n" #Source // Shader program Macro
@@ -17,13 +44,43 @@ namespace // Unnamed namespace
     const char* const WINDOW_TITLE = "7-1 Submit Your Project"; // Macro for window title
     const int WINDOW_WIDTH = 800; // Variables for window width and height
     const int WINDOW_HEIGHT = 600;
+    const char* const TEXTURE_FILES[] = { "../resources/textures/darkwood.jpg", "../resources/textures/brickwall.jpg", // Bundled textures, cooked by --cook-textures
+        "../resources/textures/bandana.png", "../resources/textures/smiley.png" };
     struct GLMesh // Stores the GL data relative to a given mesh
     {
-        GLuint vao;         // Handle for the vertex array object
-        GLuint vbo;         // Handle for the vertex buffer object
-        GLuint nVertices;    // Number of indices of the mesh
+        GLuint vao;         // Handle for the vertex array object, shared by every mesh in the pool
+        MeshAllocation range; // Where the mesh's vertices and indices live in the pool's buffers
+        Bounds bounds;      // Object-space box and sphere, for frustum culling
+        vector<glm::vec3> positions; // CPU copy of the welded positions and indices, for rasterizing the mesh as an occluder
+        vector<GLuint> indices;
+        GLuint nVertices;    // Number of unique vertices of the mesh
+        GLuint nIndices;     // Number of indices of the mesh
+        vector<MeshLod> lods; // Level 0 first; every level is an index range inside range, all sharing its vertices
+        vector<Meshlet> meshlets; // Clusters of level 0, each an index range of it
+    };
+    struct SimulationState // Everything the simulation moves, kept from the previous tick for interpolation
+    {
+        glm::vec3 cameraPosition;
+        glm::vec3 keyLightPosition;
+        glm::vec3 fillLightPosition;
+    };
+    struct SceneObject // One object of the frame: placement, color and how it is shaded
+    {
+        glm::mat4 model;
+        glm::vec4 color;
+        GLuint program;
+        GLuint texture;     // 0 when the program samples no texture
+        bool occluder;      // Large and solid: rasterized into the occlusion buffer and never tested against it
+        const char* name;   // Reported when the object is picked
+    };
+    struct PackedVertex // 20-byte GPU vertex: float position, octahedral normal (2 x snorm16), half-float texture coordinates
+    {
+        glm::vec3 position;
+        glm::uint32 normal;
+        glm::uint32 texCoords;
     };
     GLFWwindow* gWindow = nullptr; // Main GLFW window
+    MeshPool gMeshPool; // One VAO, VBO and EBO for every mesh in the PackedVertex format
     GLMesh gMesh; // Triangle mesh data
     GLuint gTextureId; // Texture
     glm::vec2 gUVScale(5.0f, 5.0f);
@@ -31,6 +88,25 @@ namespace // Unnamed namespace
     GLuint gPyramidProgramId; // Shader programs
     GLuint gTableProgramId;
     GLuint gLampProgramId;
+    UniformCache gPyramidUniforms; // Uniform locations reflected once at link time
+    UniformCache gLampUniforms;
+    FrameUniformBuffer gFrameUniforms; // Camera and light state shared by every program
+    GLStateCache gGLState; // Drops program, VAO, texture, capability and uniform calls that change nothing
+    InstanceBuffer gInstances; // Model matrix and color of every object drawn this frame
+    StreamBuffer gStream; // Frame block, instances and indirect commands of the last three frames, written straight into mapped memory
+    TextureLoader gTextureLoader; // Decodes images off the main thread, uploads them a few per frame
+    int gFramebufferWidth = WINDOW_WIDTH; // Size of what is rendered to, follows window resizes
+    int gFramebufferHeight = WINDOW_HEIGHT;
+    bool gHeadless = false; // --headless: no window (a hidden one where EGL is missing), no input, rendering goes to gOffscreen
+    HeadlessContext gHeadlessContext;
+    OffscreenTarget gOffscreen;
+    int gBenchmarkFrames = 0; // --frames N: render N frames, then print gBenchmark's report and exit
+    FrameBenchmark gBenchmark;
+    const char* gDumpPrefix = nullptr; // --dump PREFIX: write the last frame (and every --dump-every N frames) as PREFIX_NNNN.ppm
+    int gDumpEvery = 0;
+    GPUProfiler gProfiler; // GPU and CPU time of every URender pass
+    bool gShowProfiler = false; // F1 toggles the profiler overlay
+    const char* gTracePath = nullptr; // --trace PATH: write a Chrome trace of the whole run at exit (F2 writes trace.json any time)
     Camera gCamera(glm::vec3(0.0f, 0.0f, 7.0f)); // Camera
     float gLastX = WINDOW_WIDTH / 2.0f;
     float gLastY = WINDOW_HEIGHT / 2.0f;
@@ -47,22 +123,85 @@ namespace // Unnamed namespace
     glm::vec3 gKeyLightPosition(1.5f, 0.5f, 3.0f); // Light position and scale
     glm::vec3 gFillLightPosition(-1.5f, 0.5f, -3.0f);
     glm::vec3 gLightScale(0.3f);
+    vector<ClusterLight> gPointLights; // --lights N: small lamps scattered around the table, shaded through the light clusters with the key and fill lights
     bool gIsLampOrbiting = false; // Lamp animation
+    FixedTimestep gSimulationClock(1.0 / 60.0); // Camera movement and the lamp orbit advance in 60 Hz ticks, whatever the frame rate
+    SimulationState gPreviousState; // State before the latest tick; frames are rendered between it and the live state
+    RenderQueue gRenderQueue; // Two command lists, one recorded while the other is replayed
+    bool gUseRenderThread = false; // --render-thread: replay and present on a second thread that owns the GL context
+    std::thread gRenderThread;
+    GLint gRecordedWrapMode = GL_REPEAT; // Texture and viewport state already recorded, input only changes the globals
+    int gRecordedWidth = 0;
+    int gRecordedHeight = 0;
+    DrawQueue gDrawQueue; // Every draw of the frame, sorted by program, texture, VAO and depth when recorded
+    std::vector<SceneObject> gSceneObjects; // Rebuilt every recorded frame, then culled
+    BoundsCuller gCuller;
+    std::vector<std::uint32_t> gVisibleObjects;
+    std::vector<Bounds> gWorldBounds;
+    BVH gSceneBVH; // Over gWorldBounds, built once and refitted as the lamps move
+    std::vector<std::uint32_t> gStraddlingObjects; // In BVH leaves that cross a frustum plane, tested one by one
+    std::vector<std::uint32_t> gStraddlingVisible;
+    glm::mat4 gPickViewProjection(1.0f); // Of the latest recorded frame, what a click picks through
+    OcclusionBuffer gOcclusion; // 320x180 depth of the occluders, tested before anything is queued
+    bool gUseOcclusion = true; // --no-occlusion: frustum culling only
+    bool gUseClusterCulling = true; // --no-cluster-culling: meshes at full detail are drawn whole
+    float gStatsLastReport = 0.0f; // Frame statistics reported once per second
+    int gStatsFrames = 0;
+    unsigned int gStatsUniformCallsSaved = 0;
+    unsigned int gStatsDrawCalls = 0;
+    unsigned int gStatsChangesUnsorted = 0;
+    unsigned int gStatsChangesSorted = 0;
+    unsigned int gStatsObjectsTested = 0;
+    unsigned int gStatsObjectsVisible = 0;
+    unsigned int gStatsObjectsOccluded = 0;
+    unsigned int gStatsTrianglesDrawn = 0;
+    unsigned int gStatsTrianglesFull = 0;
+    unsigned int gStatsClustersTested = 0;
+    unsigned int gStatsClustersDrawn = 0;
+    unsigned int gStatsLights = 0;
+    unsigned int gStatsLightIndices = 0;
+    unsigned int gStatsLightsMaxPerCluster = 0;
+    unsigned int gStatsLightsDropped = 0;
+    StreamBuffer::Stats gStatsStream;
+    unsigned int gStatsTicks = 0;
+    GLStateCache::Stats gStatsGL;
 } // initialize the program, set the window size, redraw graphics on the window when resized, and render graphics on the screen
 bool UInitialize(int, char* [], GLFWwindow** window);
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
+void UMakeContextCurrent(bool current);
+double UGetTime();
 bool perspectiveProjection = true; // Variable to toggle between perspective and orthographic projections
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
-void UCreateMesh(GLMesh& mesh);
+void UCreateMeshPool(MeshPool& pool);
+bool UCreateMesh(GLMesh& mesh);
 void UDestroyMesh(GLMesh& mesh);
+MeshAllocation ULodRange(const GLMesh& mesh, size_t lod);
 bool UCreateTexture(const char* filename, GLuint& textureId);
 void UDestroyTexture(GLuint textureId);
-void URender();
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
+void USimulate(float step);
+SimulationState UCaptureState();
+void UPickObject(GLFWwindow* window);
+void URecordFrame(CommandList& list, float alpha);
+void UReplayFrame(const CommandList& list);
+void URenderThread();
+void UReportFrameStats(const CommandList& list, unsigned int drawCalls);
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId, UniformCache& uniforms);
 void UDestroyShaderProgram(GLuint programId);
+int UBenchmarkImageFlip();
+int UCookTextures();
+int UBenchmarkNormalMatrices();
+int UBenchmarkDrawQueue();
+int UBenchmarkCulling();
+int UBenchmarkOcclusion();
+int UBenchmarkBVH();
+int UBenchmarkLod();
+int UBenchmarkMeshlets();
+int UBenchmarkLights();
+void UScatterLights(int count, float extent, vector<ClusterLight>& lights);
+void UBuildSphere(int rings, int segments, vector<glm::vec3>& positions, vector<unsigned int>& indices);
 
 const GLchar* vertexShaderSource = GLSL(440, // Vertex Shader Source Code
     layout(location = 0) in vec3 position; // Vertex data from Vertex Attrib Pointer 0
@@ -100,19 +239,36 @@ out vec4 fragmentColor;
     );
 const GLchar* cubeVertexShaderSource = GLSL(440, // Pyramid Vertex Shader Source Code
     layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
-layout(location = 1) in vec3 normal; // VAP position 1 for normals
-layout(location = 2) in vec2 textureCoordinate;
+layout(location = 1) in vec2 normalOct; // VAP position 1 for octahedral encoded normals
+layout(location = 2) in vec2 textureCoordinate; // Half floats, widened by the vertex fetch
+layout(location = 3) in mat4 instanceModel; // Per-instance model matrix from the instance buffer (locations 3-6)
+layout(location = 8) in mat3 instanceNormalMatrix; // Inverse transpose of the model matrix, computed on the CPU per instance (locations 8-10)
 out vec3 vertexNormal; // For outgoing normals to fragment shader
 out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 out vec2 vertexTextureCoordinate;
-uniform mat4 model; //Uniform / Global variables for the  transform matrices
-uniform mat4 view;
-uniform mat4 projection;
+layout(std140, binding = 0) uniform FrameBlock // Per-frame camera and light state, uploaded once per frame
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+    vec3 keyLightColor;
+    vec3 keyLightPos;
+    vec3 fillLightColor;
+    vec3 fillLightPos;
+};
+vec3 octDecode(vec2 e) // Unfolds an octahedral encoded unit vector
+{
+    vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (v.z < 0.0)
+        v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(v);
+}
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
-    vertexFragmentPos = vec3(model * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
-    vertexNormal = mat3(transpose(inverse(model))) * normal; // get normal vectors in world space only and exclude normal translation properties
+    vec3 normal = octDecode(normalOct);
+    gl_Position = projection * view * instanceModel * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    vertexFragmentPos = vec3(instanceModel * vec4(position, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+    vertexNormal = instanceNormalMatrix * normal; // get normal vectors in world space only and exclude normal translation properties
     vertexTextureCoordinate = textureCoordinate;
 }
 );
@@ -121,149 +277,312 @@ in vec3 vertexNormal; // For incoming normals
 in vec3 vertexFragmentPos; // For incoming fragment position
 in vec2 vertexTextureCoordinate;
 out vec4 fragmentColor; // For outgoing cube color to the GPU
-// Uniform / Global variables for object color, light color, light position, and camera/view position
-uniform vec3 objectColor;
-uniform vec3 fillLightColor;
-uniform vec3 fillLightPos;
-uniform vec3 keyLightColor;
-uniform vec3 keyLightPos;
-uniform vec3 viewPosition;
+layout(std140, binding = 0) uniform FrameBlock // Camera/view position; the lights are read from the light buffers below. Declared whole, as the vertex stage does: a block must match across stages
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+    vec3 keyLightColor;
+    vec3 keyLightPos;
+    vec3 fillLightColor;
+    vec3 fillLightPos;
+};
+struct ClusterLight // Mirrors ClusterLight in light_clusters.h
+{
+    vec4 positionRange; // Range 0: no falloff, listed in every cluster
+    vec4 color;
+    vec4 shading; // Specular strength, highlight size, diffuse floor, ambient strength
+};
+layout(std430, binding = 1) readonly buffer LightBlock // Every light of the frame
+{
+    ClusterLight lights[];
+};
+layout(std430, binding = 2) readonly buffer ClusterGrid // Froxel grid size and one (first index, count) pair per froxel
+{
+    uvec4 clusterSize;
+    vec4 clusterDepth; // Near, far, slices / log(far / near)
+    vec4 clusterTile; // Tile size in pixels
+    uvec2 clusterLights[];
+};
+layout(std430, binding = 3) readonly buffer LightIndexBlock // The froxels' light lists, back to back
+{
+    uint lightIndices[];
+};
+uniform vec3 objectColor; // Uniform / Global variables for object color
 uniform sampler2D uTexture; // Useful when working with multiple textures
 uniform vec2 uvScale;
 void main()
-{   // Phong lighting model calculations to generate ambient, diffuse, and specular components
-    // Calculate Key Lamp Ambient lighting
-    float ambientStrength = 1.0f; // Set ambient or global lighting strength
-    vec3 keyAmbient = ambientStrength * keyLightColor; // Generate ambient light color
-    // Calculate Key Lamp Diffuse lighting
+{   // Phong lighting model calculations to generate ambient, diffuse, and specular components, for only the lights binned into this fragment's froxel
     vec3 norm = normalize(vertexNormal); // Normalize vectors to 1 unit
-    vec3 lightDirection = normalize(keyLightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-    float impact = max(dot(norm, lightDirection), 0.1);// Calculate diffuse impact by generating dot product of normal and light
-    vec3 keyDiffuse = impact * keyLightColor; // Generate diffuse light color
-    // Calculate Key Lamp Specular lighting
-    float specularIntensity = 5.0f; // Set specular light strength
-    float highlightSize = 16.0f; // Set specular highlight size
     vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
-    vec3 reflectDir = reflect(-lightDirection, norm); // Calculate reflection vector
-    float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize); //Calculate specular component
-    vec3 keySpecular = specularIntensity * specularComponent * keyLightColor;
-    //Calculate Fill Lamp Ambient lighting
-    ambientStrength = 0.1f; // Set ambient or global lighting strength
-    vec3 fillAmbient = ambientStrength * fillLightColor; // Generate ambient light color
-    //Calculate Fill Lamp Diffuse lighting
-    norm = normalize(vertexNormal); // Normalize vectors to 1 unit
-    lightDirection = normalize(fillLightPos - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
-    impact = max(dot(norm, lightDirection), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-    vec3 fillDiffuse = impact * fillLightColor; // Generate diffuse light color
-    // Calculate Fill Lamp Specular lighting
-    specularIntensity = 0.1f; // Set specular light strength
-    highlightSize = 16.0f; // Set specular highlight size
-    viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
-    reflectDir = reflect(-lightDirection, norm); // Calculate reflection vector
-    specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), highlightSize); //Calculate specular component
-    vec3 fillSpecular = specularIntensity * specularComponent * fillLightColor;
-    vec3 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale).xyz; // Texture holds color for all three components
-    vec3 fillResult = (fillAmbient + fillDiffuse + fillSpecular); // Calculate phong result
-    vec3 keyResult = (keyAmbient + keyDiffuse + keySpecular);
-    vec3 lightingResult = fillResult + keyResult;
+    float viewDepth = -(view * vec4(vertexFragmentPos, 1.0)).z;
+    uvec3 cell = min(uvec3(uvec2(gl_FragCoord.xy / clusterTile.xy), uint(max(log(viewDepth / clusterDepth.x) * clusterDepth.z, 0.0))), clusterSize.xyz - 1u);
+    uvec2 range = clusterLights[(cell.z * clusterSize.y + cell.y) * clusterSize.x + cell.x];
+    vec3 lightingResult = vec3(0.0);
+    for (uint i = range.x; i < range.x + range.y; i++)
+    {
+        ClusterLight light = lights[lightIndices[i]];
+        vec3 toLight = light.positionRange.xyz - vertexFragmentPos;
+        float distance = length(toLight);
+        vec3 lightDirection = toLight / max(distance, 1e-4); // Calculate distance (light direction) between light source and fragments/pixels on cube
+        float attenuation = 1.0;
+        if (light.positionRange.w > 0.0) // Smooth window reaching zero at the light's range, so the binning can stop there
+        {
+            float falloff = clamp(1.0 - pow(distance / light.positionRange.w, 4.0), 0.0, 1.0);
+            attenuation = falloff * falloff;
+        }
+        float impact = max(dot(norm, lightDirection), light.shading.z); // Calculate diffuse impact by generating dot product of normal and light
+        vec3 reflectDir = reflect(-lightDirection, norm); // Calculate reflection vector
+        float specularComponent = pow(max(dot(viewDir, reflectDir), 0.0), light.shading.y); //Calculate specular component
+        lightingResult += attenuation * (light.shading.w + impact + light.shading.x * specularComponent) * light.color.rgb; // Ambient, diffuse and specular of this lamp
+    }
+    vec2 uv = vertexTextureCoordinate * uvScale;
+    vec3 textureColor = texture(uTexture, vec2(uv.x, 1.0 - uv.y)).xyz; // Rows are stored top-down as decoded, so V is flipped here instead of flipping the image
     vec3 phong = lightingResult * textureColor;
     fragmentColor = vec4(phong, 1.0); // Send lighting results to GPU
 }
 );
 const GLchar* lampVertexShaderSource = GLSL(440, // Lamp Shader Source Code
     layout(location = 0) in vec3 position; // VAP position 0 for vertex position data
-uniform mat4 model; //Uniform / Global variables for the  transform matrices
-uniform mat4 view;
-uniform mat4 projection;
+layout(location = 3) in mat4 instanceModel; // Per-instance model matrix (locations 3-6)
+layout(location = 7) in vec4 instanceColor; // Per-instance lamp color
+out vec4 lampColor;
+layout(std140, binding = 0) uniform FrameBlock // Per-frame camera state, only view and projection are read here
+{
+    mat4 view;
+    mat4 projection;
+};
 void main()
 {
-    gl_Position = projection * view * model * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    gl_Position = projection * view * instanceModel * vec4(position, 1.0f); // Transforms vertices into clip coordinates
+    lampColor = instanceColor;
 }
 );
 const GLchar* lampFragmentShaderSource = GLSL(440, // Fragment Shader Source Code
-    out vec4 fragmentColor; // For outgoing lamp color (smaller cube) to the GPU
+    in vec4 lampColor; // Color of this lamp instance
+out vec4 fragmentColor; // For outgoing lamp color (smaller cube) to the GPU
 void main()
 {
-    fragmentColor = vec4(1.0f); // Set color to white (1.0f,1.0f,1.0f) with alpha 1.0
+    fragmentColor = lampColor;
 }
 );
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
-{ // Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-    for (int j = 0; j < height / 2; ++j)
-    {
-        int index1 = j * width * channels;
-        int index2 = (height - 1 - j) * width * channels;
-        for (int i = width * channels; i > 0; --i)
-        {
-            unsigned char tmp = image[index1];
-            image[index1] = image[index2];
-            image[index2] = tmp;
-            ++index1;
-            ++index2;
-        }
-    }
-}
 int main(int argc, char* argv[])
 {
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--bench-flip") == 0) // Time the image orientation strategies on the bundled textures, no window needed
+            return UBenchmarkImageFlip();
+        else if (strcmp(argv[i], "--cook-textures") == 0) // Write block compressed .dds files next to the bundled textures
+            return UCookTextures();
+        else if (strcmp(argv[i], "--bench-normal-matrix") == 0) // Time the per-vertex shader inverse against the per-object CPU paths
+            return UBenchmarkNormalMatrices();
+        else if (strcmp(argv[i], "--bench-draw-queue") == 0) // State changes and sort time of a scene with thousands of draws
+            return UBenchmarkDrawQueue();
+        else if (strcmp(argv[i], "--bench-culling") == 0) // Frustum test throughput, SSE batch against the scalar reference
+            return UBenchmarkCulling();
+        else if (strcmp(argv[i], "--bench-occlusion") == 0) // Occluder rasterization and box test cost, objects hidden behind a wall
+            return UBenchmarkOcclusion();
+        else if (strcmp(argv[i], "--bench-bvh") == 0) // SAH build, refit, hierarchical culling and ray picks over 100k objects
+            return UBenchmarkBVH();
+        else if (strcmp(argv[i], "--bench-lod") == 0) // LOD chain of a dense sphere and the level picked at each distance
+            return UBenchmarkLod();
+        else if (strcmp(argv[i], "--bench-meshlets") == 0) // Meshlet build and per-cluster frustum and cone culling of a dense sphere
+            return UBenchmarkMeshlets();
+        else if (strcmp(argv[i], "--bench-lights") == 0) // Froxel binning of thousands of lights and the lights each fragment would loop over
+            return UBenchmarkLights();
+        else if (strcmp(argv[i], "--headless") == 0)
+            gHeadless = true;
+        else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc)
+            gFramebufferWidth = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc)
+            gFramebufferHeight = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            gBenchmarkFrames = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc)
+            gDumpPrefix = argv[++i];
+        else if (strcmp(argv[i], "--dump-every") == 0 && i + 1 < argc)
+            gDumpEvery = std::max(0, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            gTracePath = argv[++i];
+        else if (strcmp(argv[i], "--render-thread") == 0)
+            gUseRenderThread = true;
+        else if (strcmp(argv[i], "--no-occlusion") == 0)
+            gUseOcclusion = false;
+        else if (strcmp(argv[i], "--no-cluster-culling") == 0)
+            gUseClusterCulling = false;
+        else if (strcmp(argv[i], "--lights") == 0 && i + 1 < argc)
+            UScatterLights(atoi(argv[++i]), 5.0f, gPointLights);
+    TRACE_THREAD_NAME("main");
+    if (gHeadless && gBenchmarkFrames == 0)
+        gBenchmarkFrames = 300; // A headless run always ends on its own
     if (!UInitialize(argc, argv, &gWindow))
         return EXIT_FAILURE;
     // Create the mesh
-    UCreateMesh(gMesh); // Calls the function to create the Vertex Buffer Object
+    UCreateMeshPool(gMeshPool); // Shared buffers and vertex format for every mesh
+    if (!UCreateMesh(gMesh)) // Calls the function to create the Vertex Buffer Object
+        return EXIT_FAILURE;
+    gOcclusion.Create(320, 180);
     // Create the shader programs
-    if (!UCreateShaderProgram(cubeVertexShaderSource, cubeFragmentShaderSource, gPyramidProgramId))
+    if (!UCreateShaderProgram(cubeVertexShaderSource, cubeFragmentShaderSource, gPyramidProgramId, gPyramidUniforms))
         return EXIT_FAILURE;
-    if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId))
+    if (!UCreateShaderProgram(lampVertexShaderSource, lampFragmentShaderSource, gLampProgramId, gLampUniforms))
+        return EXIT_FAILURE;
+    if (!gStream.Create((4 << 20) + LightClusters::UploadBytes(gPointLights.size() + 2))) // 4 MB per frame for about 36000 instances, plus the largest froxel lists the lights can make
+    {
+        cout << "Failed to map the stream buffer" << endl;
         return EXIT_FAILURE;
-    const char* texFilename = "../resources/textures/darkwood.jpg"; // Load texture
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gStream.buffer); // Indirect commands are always read from the stream
+    gFrameUniforms.Create(); // Per-frame uniform block, used when the stream's region is full
+    gInstances.Create(gMeshPool.VAO, gStream); // Instance attributes read the stream, draws select instances by base instance
+    gTextureLoader.Start(); // Worker pool and persistently mapped staging buffer
+    gProfiler.Create(); // Timer query ring
+    const char* texFilename = TEXTURE_FILES[0]; // Load texture, darkwood.dds is used instead when it has been cooked
     if (!UCreateTexture(texFilename, gTextureId))
     {
         cout << "Failed to load texture " << texFilename << endl;
         return EXIT_FAILURE;
     }
     // tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-    glUseProgram(gPyramidProgramId);
-    glUniform1i(glGetUniformLocation(gPyramidProgramId, "uTexture"), 0); // We set the texture as texture unit 0
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // Sets the background color of the window to black (it will be implicitely used by glClear)
-    while (!glfwWindowShouldClose(gWindow)) // render loop
-    {   // per-frame timing
-        float currentFrame = glfwGetTime();
-        gDeltaTime = currentFrame - gLastFrame;
-        gLastFrame = currentFrame;
-        UProcessInput(gWindow); // input
-        URender(); // Render this frame
-        glfwPollEvents();
+    gGLState.UseProgram(gPyramidProgramId);
+    gGLState.Uniform1i(gPyramidUniforms.Location("uTexture"), 0); // We set the texture as texture unit 0
+    gGLState.ClearColor(0.0f, 0.0f, 0.0f, 1.0f); // Sets the background color of the window to black (it will be implicitely used by glClear)
+    gGLState.Enable(GL_DEPTH_TEST); // Enable z-depth once, nothing in the frame turns it off
+    if (gHeadless)
+    {
+        if (!gOffscreen.Create(gFramebufferWidth, gFramebufferHeight))
+        {
+            cout << "Failed to create a " << gFramebufferWidth << "x" << gFramebufferHeight << " offscreen framebuffer" << endl;
+            return EXIT_FAILURE;
+        }
+        gOffscreen.Bind(); // Stays bound for the whole run
+        while (gTextureLoader.Pending() > 0) // Measure the finished scene, not the placeholder
+        {
+            gTextureLoader.Pump(8);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        gGLState.InvalidateTextures();
+    }
+    if (gBenchmarkFrames > 0)
+        gBenchmark.Start(gBenchmarkFrames);
+    gPreviousState = UCaptureState();
+    if (gUseRenderThread)
+    {   // From here on only the render thread touches GL; the main thread keeps input, simulation and recording
+        UMakeContextCurrent(false);
+        gRenderThread = std::thread(URenderThread);
     }
+    gLastFrame = (float)UGetTime(); // Loading time is not simulated
+    for (int frameIndex = 0; (gWindow == NULL || !glfwWindowShouldClose(gWindow)) && (gBenchmarkFrames == 0 || frameIndex < gBenchmarkFrames); frameIndex++) // render loop
+    {
+        gBenchmark.BeginFrame();
+        if (gHeadless)
+            gDeltaTime = (float)gSimulationClock.Step(); // One tick per frame, so every headless run renders the same frames
+        else
+        {   // per-frame timing
+            float currentFrame = glfwGetTime();
+            gDeltaTime = currentFrame - gLastFrame;
+            gLastFrame = currentFrame;
+            UProcessInput(gWindow); // input
+        }
+        int ticks = gSimulationClock.Advance(gDeltaTime); // Headless frames are exactly one tick long
+        for (int tick = 0; tick < ticks; tick++)
+        {
+            gPreviousState = UCaptureState();
+            USimulate((float)gSimulationClock.Step());
+        }
+        gBenchmark.Stage("simulate");
+        CommandList& list = gRenderQueue.BeginRecord(); // Waits only while the render thread is still replaying the frame before last
+        gBenchmark.Stage("wait");
+        list.frameIndex = frameIndex;
+        list.ticks = ticks;
+        URecordFrame(list, gSimulationClock.Alpha()); // Record this frame, blended between the last two ticks
+        gRenderQueue.Submit();
+        gBenchmark.Stage("record");
+        if (!gUseRenderThread)
+        {
+            UReplayFrame(*gRenderQueue.Acquire());
+            gRenderQueue.Release();
+            gBenchmark.Stage("replay");
+        }
+        gBenchmark.EndFrame();
+        if (gWindow)
+            glfwPollEvents();
+    }
+    gRenderQueue.Stop();
+    if (gUseRenderThread)
+    {   // Let the render thread finish the frames in flight, then take the context back for shutdown
+        gRenderThread.join();
+        UMakeContextCurrent(true);
+    }
+    if (gBenchmark.Active())
+    {
+        cout << "INFO: " << gFramebufferWidth << "x" << gFramebufferHeight << (gHeadless ? " headless" : " windowed") << (gUseRenderThread ? ", render thread" : "") << ", " << glGetString(GL_RENDERER) << endl;
+        gBenchmark.Report(cout, std::min<size_t>(10, gBenchmark.Frames() / 10)); // The first frames compile shaders and fault in buffers
+    }
+    if (gHeadless)
+        gOffscreen.Destroy();
+    if (gTracePath && !TRACE_DUMP(gTracePath))
+        cout << "Failed to write trace " << gTracePath << " (tracing needs a build with ENABLE_TRACE)" << endl;
+    gTextureLoader.Stop(); // Join the decode workers before the context goes away
     UDestroyMesh(gMesh); // Release mesh data
+    gMeshPool.Destroy(); // Release the shared mesh buffers
     UDestroyTexture(gTextureId); // Release texture
     UDestroyShaderProgram(gPyramidProgramId); // Release shader programs
     UDestroyShaderProgram(gLampProgramId); // Release shader programs
+    gFrameUniforms.Destroy(); // Release the per-frame uniform block
+    gProfiler.Destroy(); // Release the timer queries
+    gInstances.Destroy(); // Release the instance buffer
+    gStream.Destroy(); // Wait for the last frames' fences, unmap and release the stream buffer
+    gHeadlessContext.Destroy(); // Release the EGL context and display, nothing when there is a window
     exit(EXIT_SUCCESS); // Terminates the program successfully
 }
 bool UInitialize(int argc, char* argv[], GLFWwindow** window) // Initialize GLFW, GLEW, and create a window
 {
-    glfwInit(); // GLFW: initialize and configure
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    if (gHeadless && HeadlessContext::Available())
+    {   // No GLFW at all: glfwInit itself needs an X11 or Wayland display, which a build machine does not have
+        *window = NULL;
+        if (!gHeadlessContext.Create(4, 4))
+        {
+            std::cout << "Failed to create a surfaceless EGL context" << std::endl;
+            return false;
+        }
+    }
+    else
+    {
+        glfwInit(); // GLFW: initialize and configure
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 #ifdef __APPLE__
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+        glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
-    * window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL); // GLFW: window creation
-    if (*window == NULL)
+        if (gHeadless) // No EGL on this platform, a hidden window carries the context
+            glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        *window = glfwCreateWindow(gHeadless ? 16 : gFramebufferWidth, gHeadless ? 16 : gFramebufferHeight, WINDOW_TITLE, NULL, NULL); // GLFW: window creation
+        if (*window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            glfwTerminate();
+            return false;
+        }
+        glfwMakeContextCurrent(*window);
+        if (gBenchmarkFrames > 0)
+            glfwSwapInterval(0); // Frame times should measure rendering, not vsync
+    }
+    if (!gHeadless)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
-        return false;
+        glfwGetFramebufferSize(*window, &gFramebufferWidth, &gFramebufferHeight); // Differs from the window size on high-DPI displays
+        glfwSetFramebufferSizeCallback(*window, UResizeWindow);
+        glfwSetCursorPosCallback(*window, UMousePositionCallback);
+        glfwSetScrollCallback(*window, UMouseScrollCallback);
+        glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
+        glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED); // tell GLFW to capture our mouse
     }
-    glfwMakeContextCurrent(*window);
-    glfwSetFramebufferSizeCallback(*window, UResizeWindow);
-    glfwSetCursorPosCallback(*window, UMousePositionCallback);
-    glfwSetScrollCallback(*window, UMouseScrollCallback);
-    glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
-    glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED); // tell GLFW to capture our mouse
     glewExperimental = GL_TRUE; // GLEW: initialize
     GLenum GlewInitResult = glewInit();
-    if (GLEW_OK != GlewInitResult)
+    // GLEW built with GLEW_EGL loads through eglGetProcAddress and returns GLEW_OK on the EGL context. A stock Linux build
+    // loads GL through glXGetProcAddressARB, whose libglvnd entry points dispatch to whichever context is current, EGL ones
+    // included, and only then fails on the missing GLX display; GL itself is loaded by that point
+    if (GLEW_OK != GlewInitResult && !(*window == NULL && GlewInitResult == GLEW_ERROR_NO_GLX_DISPLAY))
     {
         std::cerr << glewGetErrorString(GlewInitResult) << std::endl;
         return false;
@@ -271,23 +590,27 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window) // Initialize GLFW
     cout << "INFO: OpenGL Version: " << glGetString(GL_VERSION) << endl; // Displays GPU OpenGL version
     return true;
 }
+void UMakeContextCurrent(bool current) // Attaches the GL context to the calling thread or releases it, window or headless
+{
+    if (gWindow)
+        glfwMakeContextCurrent(current ? gWindow : NULL);
+    else
+        gHeadlessContext.MakeCurrent(current);
+}
+double UGetTime() // Seconds since startup, from GLFW when there is a window and from the steady clock when there is not
+{
+    static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    if (gWindow)
+        return glfwGetTime();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
 void UProcessInput(GLFWwindow* window) // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 {
+    TRACE_ZONE("UProcessInput");
     static const float cameraSpeed = 2.5f;
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(FORWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(BACKWARD, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(LEFT, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(RIGHT, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(UP, gDeltaTime);
-    if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
-        gCamera.ProcessKeyboard(DOWN, gDeltaTime);
+    // WASDQE camera movement is sampled per tick in USimulate
     if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) { // Toggle between perspective and orthographic projections
         perspectiveProjection = true;
         cout << "Switched to perspective projection" << endl;
@@ -298,40 +621,22 @@ void UProcessInput(GLFWwindow* window) // process all input: query GLFW whether
     }
     if (glfwGetKey(window, GLFW_KEY_1) == GLFW_PRESS && gTexWrapMode != GL_REPEAT)
     {
-        glBindTexture(GL_TEXTURE_2D, gTextureId);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        gTexWrapMode = GL_REPEAT;
+        gTexWrapMode = GL_REPEAT; // Applied by the next recorded frame
         cout << "Current Texture Wrapping Mode: REPEAT" << endl;
     }
     else if (glfwGetKey(window, GLFW_KEY_2) == GLFW_PRESS && gTexWrapMode != GL_MIRRORED_REPEAT)
     {
-        glBindTexture(GL_TEXTURE_2D, gTextureId);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        gTexWrapMode = GL_MIRRORED_REPEAT;
+        gTexWrapMode = GL_MIRRORED_REPEAT; // Applied by the next recorded frame
         cout << "Current Texture Wrapping Mode: MIRRORED REPEAT" << endl;
     }
     else if (glfwGetKey(window, GLFW_KEY_3) == GLFW_PRESS && gTexWrapMode != GL_CLAMP_TO_EDGE)
     {
-        glBindTexture(GL_TEXTURE_2D, gTextureId);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        gTexWrapMode = GL_CLAMP_TO_EDGE;
+        gTexWrapMode = GL_CLAMP_TO_EDGE; // Applied by the next recorded frame
         cout << "Current Texture Wrapping Mode: CLAMP TO EDGE" << endl;
     }
     else if (glfwGetKey(window, GLFW_KEY_4) == GLFW_PRESS && gTexWrapMode != GL_CLAMP_TO_BORDER)
     {
-        float color[] = { 1.0f, 0.0f, 0.0f, 1.0f };
-        glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, color);
-        glBindTexture(GL_TEXTURE_2D, gTextureId);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-        glBindTexture(GL_TEXTURE_2D, 0);
-        gTexWrapMode = GL_CLAMP_TO_BORDER;
+        gTexWrapMode = GL_CLAMP_TO_BORDER; // Red border, applied by the next recorded frame
         cout << "Current Texture Wrapping Mode: CLAMP TO BORDER" << endl;
     }
     if (glfwGetKey(window, GLFW_KEY_RIGHT_BRACKET) == GLFW_PRESS)
@@ -344,6 +649,21 @@ void UProcessInput(GLFWwindow* window) // process all input: query GLFW whether
         gUVScale -= 0.1f;
         cout << "Current scale (" << gUVScale[0] << ", " << gUVScale[1] << ")" << endl;
     }
+    static bool isF1KeyDown = false; // Show and hide the profiler overlay, once per key press
+    bool f1Pressed = glfwGetKey(window, GLFW_KEY_F1) == GLFW_PRESS;
+    if (f1Pressed && !isF1KeyDown)
+        gShowProfiler = !gShowProfiler;
+    isF1KeyDown = f1Pressed;
+    static bool isF2KeyDown = false; // Write everything traced so far
+    bool f2Pressed = glfwGetKey(window, GLFW_KEY_F2) == GLFW_PRESS;
+    if (f2Pressed && !isF2KeyDown)
+    {
+        if (TRACE_DUMP("trace.json"))
+            cout << "Wrote trace.json" << endl;
+        else
+            cout << "Failed to write trace.json (tracing needs a build with ENABLE_TRACE)" << endl;
+    }
+    isF2KeyDown = f2Pressed;
     static bool isLKeyDown = false; // Pause and resume lamp orbiting
     if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS && !gIsLampOrbiting)
         gIsLampOrbiting = true;
@@ -352,7 +672,10 @@ void UProcessInput(GLFWwindow* window) // process all input: query GLFW whether
 } // glfw: whenever the window size changed (by OS or user resize) this callback function executes
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
-    glViewport(0, 0, width, height);
+    if (width == 0 || height == 0)
+        return; // Minimized, keep the last aspect ratio
+    gFramebufferWidth = width; // The next recorded frame sets the viewport
+    gFramebufferHeight = height;
 } // glfw: whenever the mouse moves, this callback is called
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos)
 {
@@ -379,7 +702,7 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
     case GLFW_MOUSE_BUTTON_LEFT:
     {
         if (action == GLFW_PRESS)
-            cout << "Left mouse button pressed" << endl;
+            UPickObject(window);
         else
             cout << "Left mouse button released" << endl;
     }
@@ -408,101 +731,358 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
         break;
     }
 }
-void URender() // Functioned called to render a frame
+void UPickObject(GLFWwindow* window) // Casts a ray through the cursor, or the middle of the screen while the cursor is captured, and reports the nearest object it hits
 {
+    float x = 0.0f, y = 0.0f; // Normalized device coordinates of the cursor
+    if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED)
+    {
+        double cursorX, cursorY;
+        int windowWidth, windowHeight;
+        glfwGetCursorPos(window, &cursorX, &cursorY);
+        glfwGetWindowSize(window, &windowWidth, &windowHeight);
+        x = (float)(2.0 * cursorX / std::max(windowWidth, 1) - 1.0);
+        y = (float)(1.0 - 2.0 * cursorY / std::max(windowHeight, 1)); // Window y goes down
+    }
+    glm::mat4 inverse = glm::inverse(gPickViewProjection); // The ray runs from the near plane to the far plane under the cursor
+    glm::vec4 nearPoint = inverse * glm::vec4(x, y, -1.0f, 1.0f);
+    glm::vec4 farPoint = inverse * glm::vec4(x, y, 1.0f, 1.0f);
+    Ray ray;
+    ray.origin = glm::vec3(nearPoint) / nearPoint.w;
+    ray.direction = glm::vec3(farPoint) / farPoint.w - ray.origin;
+    std::uint32_t object;
+    float distance;
+    if (gSceneBVH.Pick(ray, 1.0f, object, distance))
+        cout << "Picked the " << gSceneObjects[object].name << ", " << distance * glm::length(ray.direction) << " units from the near plane" << endl;
+    else
+        cout << "Nothing under the cursor" << endl;
+}
+SimulationState UCaptureState() // Snapshot of the simulated state
+{
+    SimulationState state;
+    state.cameraPosition = gCamera.Position;
+    state.keyLightPosition = gKeyLightPosition;
+    state.fillLightPosition = gFillLightPosition;
+    return state;
+}
+void USimulate(float step) // Advances the simulation by one fixed tick
+{
+    TRACE_ZONE("USimulate");
+    if (!gHeadless)
+    {   // Held keys move the camera by the same amount per tick at any frame rate
+        if (glfwGetKey(gWindow, GLFW_KEY_W) == GLFW_PRESS)
+            gCamera.ProcessKeyboard(FORWARD, step);
+        if (glfwGetKey(gWindow, GLFW_KEY_S) == GLFW_PRESS)
+            gCamera.ProcessKeyboard(BACKWARD, step);
+        if (glfwGetKey(gWindow, GLFW_KEY_A) == GLFW_PRESS)
+            gCamera.ProcessKeyboard(LEFT, step);
+        if (glfwGetKey(gWindow, GLFW_KEY_D) == GLFW_PRESS)
+            gCamera.ProcessKeyboard(RIGHT, step);
+        if (glfwGetKey(gWindow, GLFW_KEY_E) == GLFW_PRESS)
+            gCamera.ProcessKeyboard(UP, step);
+        if (glfwGetKey(gWindow, GLFW_KEY_Q) == GLFW_PRESS)
+            gCamera.ProcessKeyboard(DOWN, step);
+    }
     const float angularVelocity = glm::radians(45.0f); //Lamp orbits around the origin
     if (gIsLampOrbiting)
     {
-        glm::vec4 newKeyPosition = glm::rotate(angularVelocity * gDeltaTime, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(gKeyLightPosition, 1.0f);
-        gKeyLightPosition.x = newKeyPosition.x;
-        gKeyLightPosition.y = newKeyPosition.y;
-        gKeyLightPosition.z = newKeyPosition.z;
-        glm::vec4 newFillPosition = glm::rotate(angularVelocity * gDeltaTime, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::vec4(gFillLightPosition, 1.0f);
-        gFillLightPosition.x = newFillPosition.x;
-        gFillLightPosition.y = newFillPosition.y;
-        gFillLightPosition.z = newFillPosition.z;
-    }
-    glEnable(GL_DEPTH_TEST); // Enable z-depth
-    glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // Clear the frame and z buffers
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    glBindVertexArray(gMesh.vao); // Activate the cube VAO (used by cube and lamp)
-    // CUBE, Set the shader to be used
-    glUseProgram(gPyramidProgramId);
-    glm::mat4 model = glm::translate(gPyramidPosition) * glm::scale(gPyramidScale); // Model matrix: transformations are applied right-to-left order
-    glm::mat4 view = gCamera.GetViewMatrix(); // camera/view transformation
+        glm::mat4 rotation = glm::rotate(angularVelocity * step, glm::vec3(0.0f, 1.0f, 0.0f));
+        gKeyLightPosition = glm::vec3(rotation * glm::vec4(gKeyLightPosition, 1.0f));
+        gFillLightPosition = glm::vec3(rotation * glm::vec4(gFillLightPosition, 1.0f));
+    }
+}
+void URecordFrame(CommandList& list, float alpha) // Builds a frame without touching GL, alpha blends the previous tick's state into the current one
+{
+    TRACE_ZONE("URecordFrame");
+    // Interpolated state: at most one tick (16.7 ms) behind the simulation, but smooth at any frame rate
+    Camera camera = gCamera;
+    camera.Position = glm::mix(gPreviousState.cameraPosition, gCamera.Position, alpha);
+    glm::vec3 keyLightPosition = glm::mix(gPreviousState.keyLightPosition, gKeyLightPosition, alpha);
+    glm::vec3 fillLightPosition = glm::mix(gPreviousState.fillLightPosition, gFillLightPosition, alpha);
+    if (gRecordedWidth != gFramebufferWidth || gRecordedHeight != gFramebufferHeight)
+    {
+        list.Viewport(gFramebufferWidth, gFramebufferHeight);
+        gRecordedWidth = gFramebufferWidth;
+        gRecordedHeight = gFramebufferHeight;
+    }
+    if (gRecordedWrapMode != gTexWrapMode)
+    {
+        const GLfloat borderColor[] = { 1.0f, 0.0f, 0.0f, 1.0f };
+        list.TextureWrap(gTextureId, gTexWrapMode, borderColor);
+        gRecordedWrapMode = gTexWrapMode;
+    }
+    list.BeginPass("clear");
+    list.Clear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT, 0.0f, 0.0f, 0.0f, 1.0f); // The overlay changes the clear color, filtered out when it did not run
+    list.EndPass();
+    glm::mat4 view = camera.GetViewMatrix(); // camera/view transformation
     glm::mat4 projection;// Creates either a perspective or orthographic projection based on the toggle
     if (perspectiveProjection) { // Creates a perspective projection
-        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+        projection = glm::perspective(glm::radians(gCamera.Zoom), (GLfloat)gFramebufferWidth / (GLfloat)gFramebufferHeight, 0.1f, 100.0f);
     }
     else { // Creates an orthographic projection
         projection = glm::ortho(-3.0f, 3.0f, -3.0f, 3.0f, 0.1f, 100.0f);
-    } // Retrieves and passes transform matrices to the Shader program
-    GLint modelLoc = glGetUniformLocation(gPyramidProgramId, "model");
-    GLint viewLoc = glGetUniformLocation(gPyramidProgramId, "view");
-    GLint projLoc = glGetUniformLocation(gPyramidProgramId, "projection");
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-    // Reference matrix uniforms from the Cube Shader program for the cub color, light color, light position, and camera position
-    GLint objectColorLoc = glGetUniformLocation(gPyramidProgramId, "objectColor");
-    GLint keyLightColorLoc = glGetUniformLocation(gPyramidProgramId, "keyLightColor");
-    GLint keyLightPositionLoc = glGetUniformLocation(gPyramidProgramId, "keyLightPos");
-    GLint fillLightColorLoc = glGetUniformLocation(gPyramidProgramId, "fillLightColor");
-    GLint fillLightPositionLoc = glGetUniformLocation(gPyramidProgramId, "fillLightPos");
-    GLint viewPositionLoc = glGetUniformLocation(gPyramidProgramId, "viewPosition");
-    GLint uvScaleLoc = glGetUniformLocation(gPyramidProgramId, "uvScale");
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3fv(objectColorLoc, 1, glm::value_ptr(gObjectColor));
-    glUniform3fv(fillLightColorLoc, 1, glm::value_ptr(gFillLightColor));
-    glUniform3fv(fillLightPositionLoc, 1, glm::value_ptr(gFillLightPosition));
-    glUniform3fv(keyLightColorLoc, 1, glm::value_ptr(gKeyLightColor));
-    glUniform3fv(keyLightPositionLoc, 1, glm::value_ptr(gKeyLightPosition));
-    glUniform3fv(viewPositionLoc, 1, glm::value_ptr(gCamera.Position));
-    glUniform2fv(uvScaleLoc, 1, glm::value_ptr(gUVScale));
-    // Pass color, light, and camera data to the Cube Shader program's corresponding uniforms
-    glUniform3f(objectColorLoc, gObjectColor.r, gObjectColor.g, gObjectColor.b);
-    glUniform3f(fillLightColorLoc, gFillLightColor.r, gFillLightColor.g, gFillLightColor.b);
-    glUniform3f(fillLightPositionLoc, gFillLightPosition.x, gFillLightPosition.y, gFillLightPosition.z);
-    glUniform3f(keyLightColorLoc, gKeyLightColor.r, gKeyLightColor.g, gKeyLightColor.b);
-    glUniform3f(keyLightPositionLoc, gKeyLightPosition.x, gKeyLightPosition.y, gKeyLightPosition.z);
-    const glm::vec3 cameraPosition = gCamera.Position;
-    glUniform3f(viewPositionLoc, cameraPosition.x, cameraPosition.y, cameraPosition.z);
-    GLint UVScaleLoc = glGetUniformLocation(gPyramidProgramId, "uvScale");
-    glUniform2fv(UVScaleLoc, 1, glm::value_ptr(gUVScale));
-    // bind textures on corresponding texture units
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, gTextureId);
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices); // Draws the triangles
-    // KEY LAMP: draw lamp
-    glUseProgram(gLampProgramId);
-    model = glm::translate(gKeyLightPosition) * glm::scale(gLightScale); //Transform the smaller cube used as a visual que for the light source
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLampProgramId, "model");
-    viewLoc = glGetUniformLocation(gLampProgramId, "view");
-    projLoc = glGetUniformLocation(gLampProgramId, "projection");
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices);
-    glUseProgram(gLampProgramId); // Fill Lamp
-    model = glm::translate(gFillLightPosition) * glm::scale(gLightScale); //Transform the smaller cube used as a visual que for the light source
-    // Reference matrix uniforms from the Lamp Shader program
-    modelLoc = glGetUniformLocation(gLampProgramId, "model");
-    viewLoc = glGetUniformLocation(gLampProgramId, "view");
-    projLoc = glGetUniformLocation(gLampProgramId, "projection");
-    // Pass matrix data to the Lamp Shader program's matrix uniforms
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
-    glDrawArrays(GL_TRIANGLES, 0, gMesh.nVertices);
-    // Deactivate the Vertex Array Object and shader program
-    glBindVertexArray(0);
-    glUseProgram(0);
-    // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-    glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+    }
+    FrameUniforms& frame = list.frame; // Camera and light state shared by every program, uploaded once per frame
+    frame.view = view;
+    frame.projection = projection;
+    frame.viewPosition = glm::vec4(camera.Position, 1.0f);
+    frame.keyLightColor = glm::vec4(gKeyLightColor, 1.0f);
+    frame.keyLightPosition = glm::vec4(keyLightPosition, 1.0f);
+    frame.fillLightColor = glm::vec4(gFillLightColor, 1.0f);
+    frame.fillLightPosition = glm::vec4(fillLightPosition, 1.0f);
+    // Every light goes into the froxel grid; a fragment loops over only its froxel's list. Key and fill have no falloff and are in every list
+    list.lights.Add(keyLightPosition, 0.0f, gKeyLightColor, 5.0f, 16.0f, 0.1f, 1.0f);
+    list.lights.Add(fillLightPosition, 0.0f, gFillLightColor, 0.1f, 16.0f, 0.0f, 0.1f);
+    list.lights.lights.insert(list.lights.lights.end(), gPointLights.begin(), gPointLights.end());
+    list.lights.Build(view, projection, 0.1f, 100.0f, gFramebufferWidth, gFramebufferHeight);
+    list.lightsMaxPerCluster = list.lights.MaxLightsPerCluster();
+    // Build the frame's objects, then cull them against the view frustum; objects off screen cost neither instances nor draws
+    gSceneObjects.clear();
+    SceneObject table = { glm::translate(gPyramidPosition) * glm::scale(gPyramidScale), glm::vec4(gObjectColor, 1.0f), gPyramidProgramId, gTextureId, true, "table" }; // Model matrix: transformations are applied right-to-left order
+    SceneObject keyLamp = { glm::translate(keyLightPosition) * glm::scale(gLightScale), glm::vec4(1.0f), gLampProgramId, 0, false, "key lamp" }; // Key and fill lamps are white cubes
+    SceneObject fillLamp = { glm::translate(fillLightPosition) * glm::scale(gLightScale), glm::vec4(1.0f), gLampProgramId, 0, false, "fill lamp" };
+    gSceneObjects.push_back(table);
+    gSceneObjects.push_back(keyLamp);
+    gSceneObjects.push_back(fillLamp);
+    gWorldBounds.clear();
+    for (size_t i = 0; i < gSceneObjects.size(); i++)
+        gWorldBounds.push_back(TransformBounds(gMesh.bounds, gSceneObjects[i].model));
+    if (gSceneBVH.ObjectCount() != gWorldBounds.size())
+        gSceneBVH.Build(&gWorldBounds[0], gWorldBounds.size()); // The set of objects changed
+    else
+        gSceneBVH.Refit(&gWorldBounds[0]); // Same objects, some moved: keep the tree, refit its boxes
+    // The hierarchy accepts or rejects whole subtrees; only objects in leaves crossing a plane go through the SSE culler
+    Frustum frustum = ExtractFrustum(projection * view);
+    gSceneBVH.Cull(frustum, gVisibleObjects, gStraddlingObjects);
+    gCuller.Clear();
+    for (size_t i = 0; i < gStraddlingObjects.size(); i++)
+        gCuller.Add(gWorldBounds[gStraddlingObjects[i]]);
+    gCuller.Cull(frustum, gStraddlingVisible);
+    for (size_t i = 0; i < gStraddlingVisible.size(); i++)
+        gVisibleObjects.push_back(gStraddlingObjects[gStraddlingVisible[i]]);
+    gPickViewProjection = projection * view;
+    list.objectsTested = (unsigned int)gSceneObjects.size();
+    list.objectsVisible = (unsigned int)gVisibleObjects.size();
+    list.objectsOccluded = 0;
+    if (gUseOcclusion) // Rasterize the visible occluders, then drop every other object they completely hide
+    {
+        gOcclusion.Clear(projection * view);
+        for (size_t i = 0; i < gVisibleObjects.size(); i++)
+            if (gSceneObjects[gVisibleObjects[i]].occluder)
+                gOcclusion.RenderOccluder(&gMesh.positions[0], gMesh.positions.size(), sizeof(glm::vec3), &gMesh.indices[0], gMesh.indices.size(), gSceneObjects[gVisibleObjects[i]].model);
+        gOcclusion.Finish();
+        size_t kept = 0;
+        for (size_t i = 0; i < gVisibleObjects.size(); i++)
+        {
+            std::uint32_t index = gVisibleObjects[i];
+            if (gSceneObjects[index].occluder || gOcclusion.TestBounds(gWorldBounds[index]))
+                gVisibleObjects[kept++] = index;
+        }
+        list.objectsOccluded = (unsigned int)(gVisibleObjects.size() - kept);
+        gVisibleObjects.resize(kept);
+    }
+    // Gather every visible object's model matrix and color into the instance stream and queue its draw, in any order:
+    // the queue sorts them by state and front to back, and merges copies with neighbouring instances into one command
+    // Each object draws the coarsest level of detail whose error stays under a pixel at its distance
+    gDrawQueue.Clear();
+    gDrawQueue.SetDepthRange(0.1f, 100.0f);
+    list.trianglesDrawn = 0;
+    list.trianglesFull = 0;
+    list.clustersTested = 0;
+    list.clustersDrawn = 0;
+    for (size_t i = 0; i < gVisibleObjects.size(); i++)
+    {
+        const SceneObject& object = gSceneObjects[gVisibleObjects[i]];
+        const Bounds& world = gWorldBounds[gVisibleObjects[i]];
+        size_t lod = 0; // An orthographic view shows every object at the same scale, keep full detail
+        if (perspectiveProjection)
+            lod = SelectLod(gMesh.lods, world.radius / std::max(gMesh.bounds.radius, 1e-6f), glm::length(world.center - camera.Position), glm::radians(gCamera.Zoom), (float)gFramebufferHeight);
+        MeshAllocation range = ULodRange(gMesh, lod);
+        list.trianglesFull += gMesh.lods[0].indexCount / 3;
+        GLuint instance = list.AddInstance(object.model, object.color);
+        float depth = -(view * object.model[3]).z;
+        if (lod != 0 || !gUseClusterCulling || gMesh.meshlets.size() < 2)
+        {
+            list.trianglesDrawn += range.indexCount / 3;
+            gDrawQueue.Add(DrawQueue::OPAQUE_PASS, object.program, object.texture, gMesh.vao, depth, GL_TRIANGLES, range, 1, instance);
+            continue;
+        }
+        // Close enough for full detail: only the meshlets on screen and facing the camera are drawn, one indirect command each,
+        // and the queue still submits them all in one multi-draw call
+        float scale = world.radius / std::max(gMesh.bounds.radius, 1e-6f);
+        for (size_t m = 0; m < gMesh.meshlets.size(); m++)
+        {
+            const Meshlet& meshlet = gMesh.meshlets[m];
+            list.clustersTested++;
+            if (!MeshletVisible(meshlet, object.model, scale, frustum, camera.Position, perspectiveProjection))
+                continue;
+            MeshAllocation cluster = range;
+            cluster.firstIndex += meshlet.firstIndex;
+            cluster.indexCount = meshlet.indexCount;
+            list.clustersDrawn++;
+            list.trianglesDrawn += cluster.indexCount / 3;
+            gDrawQueue.Add(DrawQueue::OPAQUE_PASS, object.program, object.texture, gMesh.vao, depth, GL_TRIANGLES, cluster, 1, instance);
+        }
+    }
+    list.BeginPass("scene");
+    // CUBE, Pass color and texture scale data to the Cube Shader program's corresponding uniforms, skipped at replay while unchanged
+    list.UseProgram(gPyramidProgramId);
+    list.Uniform3fv(gPyramidUniforms.Location("objectColor"), glm::value_ptr(gObjectColor));
+    list.Uniform2fv(gPyramidUniforms.Location("uvScale"), glm::value_ptr(gUVScale));
+    DrawQueue::Stats queueStats = gDrawQueue.Flush(list); // One multi-draw per program, both lamps merge into one indirect command when they sort next to each other
+    list.EndPass();
+    list.stateChangesUnsorted = queueStats.changesUnsorted;
+    list.stateChangesSorted = queueStats.changesSorted;
+    if (gShowProfiler)
+    {
+        list.BeginPass("hud");
+        list.ProfilerHUD(gFramebufferHeight);
+        list.EndPass();
+    }
+    // The VAO and program stay bound, so the next frame's binds are filtered out instead of re-issued
+    list.uniformCallsSaved = UniformCache::TakeCallsSaved();
+    list.droppedSeconds = gSimulationClock.DroppedSeconds();
+}
+void UReplayFrame(const CommandList& list) // Issues a recorded frame and presents it, on whichever thread owns the context
+{
+    TRACE_ZONE("UReplayFrame");
+    gProfiler.BeginFrame(); // Picks up the timings of earlier frames that have finished on the GPU
+    gProfiler.Begin("stream"); // CPU time of this pass is the stream buffer's fence wait, non-zero only when the GPU is three frames behind
+    gStream.BeginFrame();
+    gProfiler.End();
+    if (gTextureLoader.Pump() > 0) // Swap in textures whose decode finished since the last frame
+        gGLState.InvalidateTextures();
+    gFrameUniforms.Upload(list.frame, gStream);
+    gInstances.instances.assign(list.instances.begin(), list.instances.end()); // Reuses the buffer's capacity
+    GLuint firstInstance = 0;
+    StreamBuffer::Allocation indirect = { NULL, 0 };
+    if (list.lights.Upload(gStream) && gInstances.Upload(gStream, firstInstance))
+        indirect = gStream.Allocate(list.indirect.size() * sizeof(DrawElementsIndirectCommand), sizeof(GLuint));
+    unsigned int drawCalls = 0;
+    if (indirect.data)
+    {   // Every draw's base instance moves to where this frame's instances landed in the stream
+        DrawElementsIndirectCommand* commands = (DrawElementsIndirectCommand*)indirect.data;
+        for (size_t i = 0; i < list.indirect.size(); i++)
+        {
+            commands[i] = list.indirect[i];
+            commands[i].baseInstance += firstInstance;
+        }
+        drawCalls = list.Replay(gGLState, gProfiler, indirect.offset);
+    }
+    gStream.EndFrame(); // A frame that did not fit is skipped, UReportFrameStats warns about it
+    gProfiler.Begin("present");
+    if (gHeadless)
+        glFinish(); // Nothing is presented; wait for the GPU (or llvmpipe) so the frame time includes its work
+    else // glfw: swap buffers (input is polled by the main thread)
+    {
+        TRACE_ZONE("glfwSwapBuffers");
+        glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+    }
+    gProfiler.End();
+    gProfiler.EndFrame();
+    int frameIndex = list.frameIndex;
+    if (gHeadless && gDumpPrefix && (frameIndex == gBenchmarkFrames - 1 || (gDumpEvery > 0 && frameIndex % gDumpEvery == 0)))
+    {
+        std::string index = std::to_string(frameIndex);
+        std::string path = std::string(gDumpPrefix) + "_" + std::string(index.size() < 4 ? 4 - index.size() : 0, '0') + index + ".ppm";
+        if (!gOffscreen.WritePPM(path.c_str()))
+            cout << "Failed to write " << path << endl;
+    }
+    UReportFrameStats(list, drawCalls);
+}
+void URenderThread() // Owns the GL context from the first frame to the last, replaying whatever the main thread submits
+{
+    TRACE_THREAD_NAME("render");
+    UMakeContextCurrent(true);
+    while (const CommandList* list = gRenderQueue.Acquire())
+    {
+        UReplayFrame(*list);
+        gRenderQueue.Release();
+    }
+    UMakeContextCurrent(false);
+}
+void UReportFrameStats(const CommandList& list, unsigned int drawCalls) // Accumulates per-frame counters and prints their per-frame averages once per second
+{
+    gStatsFrames++;
+    gStatsTicks += list.ticks;
+    gStatsUniformCallsSaved += list.uniformCallsSaved;
+    gStatsDrawCalls += drawCalls;
+    gStatsChangesUnsorted += list.stateChangesUnsorted;
+    gStatsChangesSorted += list.stateChangesSorted;
+    gStatsObjectsTested += list.objectsTested;
+    gStatsObjectsVisible += list.objectsVisible;
+    gStatsObjectsOccluded += list.objectsOccluded;
+    gStatsTrianglesDrawn += list.trianglesDrawn;
+    gStatsTrianglesFull += list.trianglesFull;
+    gStatsClustersTested += list.clustersTested;
+    gStatsClustersDrawn += list.clustersDrawn;
+    gStatsLights += (unsigned int)list.lights.lights.size();
+    gStatsLightIndices += (unsigned int)list.lights.indices.size();
+    gStatsLightsMaxPerCluster = std::max(gStatsLightsMaxPerCluster, list.lightsMaxPerCluster);
+    gStatsLightsDropped += list.lights.dropped;
+    StreamBuffer::Stats stream = gStream.TakeStats();
+    gStatsStream.stalls += stream.stalls;
+    gStatsStream.stallMs += stream.stallMs;
+    gStatsStream.failedAllocations += stream.failedAllocations;
+    gStatsStream.peakBytes = std::max(gStatsStream.peakBytes, stream.peakBytes);
+    GLStateCache::Stats gl = gGLState.TakeStats();
+    gStatsGL.issued += gl.issued;
+    gStatsGL.skippedPrograms += gl.skippedPrograms;
+    gStatsGL.skippedVertexArrays += gl.skippedVertexArrays;
+    gStatsGL.skippedTextures += gl.skippedTextures;
+    gStatsGL.skippedState += gl.skippedState;
+    gStatsGL.skippedUniforms += gl.skippedUniforms;
+    float now = (float)UGetTime();
+    if (now - gStatsLastReport < 1.0f)
+        return;
+    cout << "INFO: " << gStatsFrames << " frames, " << gStatsTicks << " simulation ticks (" << list.droppedSeconds << " s dropped after stalls)" << endl;
+    cout << "INFO: " << gStatsFrames << " frames, glGetUniformLocation calls removed per frame: " << gStatsUniformCallsSaved / gStatsFrames << endl;
+    cout << "INFO: draw calls per frame: " << gStatsDrawCalls / gStatsFrames << " for " << gInstances.instances.size() << " instances, program/texture/VAO changes "
+        << gStatsChangesUnsorted / gStatsFrames << " unsorted, " << gStatsChangesSorted / gStatsFrames << " sorted" << endl;
+    cout << "INFO: objects per frame: " << gStatsObjectsVisible / gStatsFrames << " of " << gStatsObjectsTested / gStatsFrames << " inside the view frustum ("
+        << (gStatsObjectsTested > 0 ? 100.0f * (gStatsObjectsTested - gStatsObjectsVisible) / gStatsObjectsTested : 0.0f) << "% culled), "
+        << gStatsObjectsOccluded / gStatsFrames << " of those hidden by occluders" << endl;
+    cout << "INFO: triangles per frame: " << gStatsTrianglesDrawn / gStatsFrames << " at the selected levels of detail, " << gStatsTrianglesFull / gStatsFrames << " at full detail, "
+        << gStatsClustersDrawn / gStatsFrames << " of " << gStatsClustersTested / gStatsFrames << " meshlets drawn" << endl;
+    cout << "INFO: lights per frame: " << gStatsLights / gStatsFrames << ", " << (float)gStatsLightIndices / gStatsFrames / LightClusters::CLUSTERS << " per froxel on average, at most "
+        << gStatsLightsMaxPerCluster << " in one froxel" << endl;
+    if (gStatsLightsDropped > 0)
+        cout << "WARNING: froxels hold at most " << LightClusters::MAX_LIGHTS_PER_CLUSTER << " lights, " << gStatsLightsDropped / gStatsFrames << " froxel entries per frame were dropped" << endl;
+    cout << "INFO: GL state calls per frame: " << gStatsGL.issued / gStatsFrames << " issued, " << gStatsGL.Skipped() / gStatsFrames << " removed ("
+        << gStatsGL.skippedPrograms / gStatsFrames << " program, " << gStatsGL.skippedVertexArrays / gStatsFrames << " VAO, "
+        << gStatsGL.skippedTextures / gStatsFrames << " texture, " << gStatsGL.skippedState / gStatsFrames << " state, "
+        << gStatsGL.skippedUniforms / gStatsFrames << " uniform)" << endl;
+    cout << "INFO: pass ms (GPU/CPU):";
+    const std::vector<GPUProfiler::Pass>& passes = gProfiler.Passes();
+    for (size_t i = 0; i < passes.size(); i++)
+        cout << " " << passes[i].name << " " << passes[i].gpuAverage << "/" << passes[i].cpuAverage;
+    cout << ", " << gProfiler.Dropped() << " frames of queries dropped" << endl;
+    cout << "INFO: stream buffer peak " << gStatsStream.peakBytes / 1024 << " KB per frame, " << gStatsStream.stalls << " stalls (" << gStatsStream.stallMs << " ms)" << endl;
+    if (gStatsStream.stalls > 0)
+        cout << "WARNING: the CPU got " << StreamBuffer::REGIONS << " frames ahead of the GPU and waited on the stream buffer " << gStatsStream.stalls << " times" << endl;
+    if (gStatsStream.failedAllocations > 0)
+        cout << "WARNING: " << gStatsStream.failedAllocations << " stream buffer allocations did not fit, those frames were not drawn" << endl;
+    gStatsLastReport = now;
+    gStatsFrames = 0;
+    gStatsUniformCallsSaved = 0;
+    gStatsDrawCalls = 0;
+    gStatsChangesUnsorted = 0;
+    gStatsChangesSorted = 0;
+    gStatsObjectsTested = 0;
+    gStatsObjectsVisible = 0;
+    gStatsObjectsOccluded = 0;
+    gStatsTrianglesDrawn = 0;
+    gStatsTrianglesFull = 0;
+    gStatsClustersTested = 0;
+    gStatsClustersDrawn = 0;
+    gStatsLights = 0;
+    gStatsLightIndices = 0;
+    gStatsLightsMaxPerCluster = 0;
+    gStatsLightsDropped = 0;
+    gStatsStream = StreamBuffer::Stats();
+    gStatsTicks = 0;
+    gStatsGL = GLStateCache::Stats();
 }
-void UCreateMesh(GLMesh& mesh) // Implements the UCreateMesh function
+bool UCreateMesh(GLMesh& mesh) // Implements the UCreateMesh function, false when the mesh pool cannot hold it
 {
     GLfloat verts[] = { // Position and Texture data
         //Positions          //Normals                 //Textures
@@ -656,64 +1236,87 @@ void UCreateMesh(GLMesh& mesh) // Implements the UCreateMesh function
     const GLuint floatsPerVertex = 3;
     const GLuint floatsPerNormal = 3;
     const GLuint floatsPerUV = 2;
-    mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-    glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-    glBindVertexArray(mesh.vao);
-    glGenBuffers(1, &mesh.vbo); // Create 1 buffer for the combined vertex, normal, and texture coordinate data
-    glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex data to the GPU
-    GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV); // Strides between vertex coordinates, normals, and texture coordinates
+    const GLuint floatStride = floatsPerVertex + floatsPerNormal + floatsPerUV; // Floats per source vertex
+    GLint stride = sizeof(PackedVertex); // Strides between packed vertices on the GPU
+    const size_t triangleListVertices = sizeof(verts) / (sizeof(float) * floatStride);
+    vector<PackedVertex> packed(triangleListVertices); // Pack first so vertices that only differ below the packed precision weld too
+    for (size_t i = 0; i < triangleListVertices; i++)
+    {
+        const GLfloat* v = verts + i * floatStride;
+        packed[i].position = glm::vec3(v[0], v[1], v[2]);
+        packed[i].normal = PackNormal(glm::vec3(v[3], v[4], v[5]));
+        packed[i].texCoords = PackTexCoords(glm::vec2(v[6], v[7]));
+    }
+    // Weld the duplicated corners of the triangle list into unique vertices plus an index buffer
+    vector<unsigned char> vertexData;
+    vector<unsigned int> indices;
+    mesh.nVertices = (GLuint)WeldVertices(&packed[0], triangleListVertices, stride, vertexData, indices);
+    mesh.nIndices = (GLuint)indices.size();
+    size_t indexedBytes = vertexData.size() + indices.size() * sizeof(unsigned int);
+    vector<unsigned int> unindexed(triangleListVertices); // The old glDrawArrays order, for comparison
+    for (size_t i = 0; i < unindexed.size(); i++)
+        unindexed[i] = (unsigned int)i;
+    VertexCacheStats before = SimulateVertexCache(&unindexed[0], unindexed.size(), unindexed.size());
+    VertexCacheStats after = SimulateVertexCache(&indices[0], indices.size(), mesh.nVertices);
+    OptimizeMesh(indices, vertexData, stride); // Tipsify triangle order, overdraw cluster order, then vertex fetch order
+    VertexCacheStats optimized = SimulateVertexCache(&indices[0], indices.size(), mesh.nVertices);
+    cout << "INFO: mesh welded " << triangleListVertices << " -> " << mesh.nVertices << " vertices, "
+        << sizeof(verts) << " -> " << indexedBytes << " bytes, post-transform cache hit rate "
+        << before.hitRate * 100.0f << "% -> " << after.hitRate * 100.0f << "% (ACMR " << before.acmr << " -> " << after.acmr << ")" << endl;
+    cout << "INFO: mesh reordered for the vertex cache, ACMR " << after.acmr << " -> " << optimized.acmr << ", ATVR " << after.atvr << " -> " << optimized.atvr << endl;
+    mesh.bounds = ComputeBounds((const glm::vec3*)&vertexData[0], mesh.nVertices, stride); // Position is the first member of PackedVertex
+    mesh.positions.resize(mesh.nVertices);
+    for (GLuint i = 0; i < mesh.nVertices; i++)
+        mesh.positions[i] = *(const glm::vec3*)&vertexData[i * stride];
+    mesh.meshlets = BuildMeshlets(indices, &vertexData[0], mesh.nVertices, stride); // Groups level 0's triangles into contiguous clusters
+    mesh.indices.assign(indices.begin(), indices.end());
+    mesh.lods = GenerateLodChain(indices, &vertexData[0], mesh.nVertices, stride); // Coarser levels are appended to indices, the pool stores them all
+    cout << "INFO: " << mesh.lods.size() << " levels of detail, " << mesh.lods.back().indexCount / 3 << " triangles at the coarsest" << endl;
+    mesh.vao = gMeshPool.VAO; // Sends the unique vertices and their indices into the shared buffers
+    if (!gMeshPool.Allocate(&vertexData[0], mesh.nVertices, &indices[0], (GLuint)indices.size(), mesh.range))
+    {
+        cout << "ERROR: mesh pool is full, " << mesh.nVertices << " vertices and " << indices.size() << " indices do not fit" << endl;
+        return false; // mesh.lods would index pool ranges that belong to no mesh
+    }
+    return true;
+}
+void UCreateMeshPool(MeshPool& pool) // Creates the shared buffers and describes the PackedVertex format once for every mesh
+{
+    GLint stride = sizeof(PackedVertex); // Strides between packed vertices on the GPU
+    pool.Create(stride, 1 << 16, 1 << 18);
     // Create Vertex Attribute Pointers
-    glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0); // Vertex positions
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0); // Vertex positions
     glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* floatsPerVertex)); // Normals
+    glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, normal)); // Octahedral normals, read as a vec2 in [-1, 1]
     glEnableVertexAttribArray(1);
-    glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal))); // Texture Coordinates
+    glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, texCoords)); // Half-float texture coordinates
     glEnableVertexAttribArray(2);
+    glBindVertexArray(0);
 }
 void UDestroyMesh(GLMesh& mesh)
 {
-    glDeleteVertexArrays(1, &mesh.vao);
-    glDeleteBuffers(1, &mesh.vbo);
+    gMeshPool.Free(mesh.range); // The pool's buffers are released with the pool
 }
-bool UCreateTexture(const char* filename, GLuint& textureId) // Generate and load the texture
+MeshAllocation ULodRange(const GLMesh& mesh, size_t lod) // One level of detail as a draw range: its own indices, the mesh's vertices
 {
-    int width, height, channels;
-    unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-    if (image)
-    {
-        flipImageVertically(image, width, height, channels);
-        glGenTextures(1, &textureId);
-        glBindTexture(GL_TEXTURE_2D, gTextureId);
-        // set the texture wrapping parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        // set texture filtering parameters
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        if (channels == 3)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-        else if (channels == 4)
-            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-        else
-        {
-            cout << "Not implemented to handle image with " << channels << " channels" << endl;
-            return false;
-        }
-        glGenerateMipmap(GL_TEXTURE_2D);
-        stbi_image_free(image);
-        glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
-        return true;
-    }
-    return false; // Error loading the image
+    MeshAllocation range = mesh.range;
+    range.firstIndex += mesh.lods[lod].firstIndex;
+    range.indexCount = mesh.lods[lod].indexCount;
+    return range;
+}
+bool UCreateTexture(const char* filename, GLuint& textureId) // Generate the texture and queue its image for loading
+{ // The texture shows a placeholder until a worker has decoded the file and Pump() has uploaded it
+    TRACE_ZONE("UCreateTexture");
+    textureId = gTextureLoader.Request(filename, false); // The fragment shader flips V, so the image is used exactly as decoded
+    return textureId != 0;
 }
 void UDestroyTexture(GLuint textureId)
 {
     glGenTextures(1, &textureId);
 }
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId, UniformCache& uniforms)
 { // Implements the UCreateShaders function
+    TRACE_ZONE("UCreateShaderProgram");
     int success = 0; // Compilation and linkage error reporting
     char infoLog[512];
     programId = glCreateProgram(); // Create a Shader program object.
@@ -749,6 +1352,7 @@ bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSou
         std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
         return false;
     }
+    uniforms.Reflect(programId); // Cache every active uniform location once, URender never queries the driver
     glUseProgram(programId); // Uses the shader program
     return true;
 }
@@ -756,3 +1360,566 @@ void UDestroyShaderProgram(GLuint programId) // Destroy Shader
 {
     glDeleteProgram(programId);
 }
+int UBenchmarkImageFlip() // Compares the ways of getting a decoded image into OpenGL's bottom-up row order
+{
+    const int repeats = 20;
+    typedef std::chrono::steady_clock Clock;
+    for (const char* file : TEXTURE_FILES)
+    {
+        int width, height, channels;
+        double decodeMs = 0.0, decodeFlippedMs = 0.0, scalarMs = 0.0, memcpyMs = 0.0;
+        unsigned char* image = NULL;
+        for (int r = 0; r < repeats; r++)
+        {
+            stbi_set_flip_vertically_on_load_thread(0);
+            Clock::time_point start = Clock::now();
+            unsigned char* plain = stbi_load(file, &width, &height, &channels, 0);
+            decodeMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            stbi_set_flip_vertically_on_load_thread(1);
+            start = Clock::now();
+            unsigned char* flipped = stbi_load(file, &width, &height, &channels, 0);
+            decodeFlippedMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            stbi_set_flip_vertically_on_load_thread(0);
+            if (!plain || !flipped)
+            {
+                cout << "Failed to load texture " << file << endl;
+                stbi_image_free(plain);
+                stbi_image_free(flipped);
+                return EXIT_FAILURE;
+            }
+            stbi_image_free(flipped);
+            if (image)
+                stbi_image_free(plain);
+            else
+                image = plain;
+        }
+        for (int r = 0; r < repeats; r++)
+        {
+            Clock::time_point start = Clock::now();
+            for (int j = 0; j < height / 2; ++j) // The original byte-at-a-time row swap, kept here as the baseline
+            {
+                int index1 = j * width * channels;
+                int index2 = (height - 1 - j) * width * channels;
+                for (int i = width * channels; i > 0; --i)
+                {
+                    unsigned char tmp = image[index1];
+                    image[index1] = image[index2];
+                    image[index2] = tmp;
+                    ++index1;
+                    ++index2;
+                }
+            }
+            scalarMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+            start = Clock::now();
+            flipImageVertically(image, width, height, channels);
+            memcpyMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        }
+        stbi_image_free(image);
+        cout << "INFO: " << file << " " << width << "x" << height << "x" << channels
+            << " decode " << decodeMs / repeats << " ms"
+            << " | flip: scalar " << scalarMs / repeats << " ms"
+            << ", memcpy " << memcpyMs / repeats << " ms"
+            << ", stb on load +" << (decodeFlippedMs - decodeMs) / repeats << " ms"
+            << ", shader 0 ms" << endl;
+    }
+    return EXIT_SUCCESS;
+}
+int UCookTextures() // Offline step: decode each bundled texture once and store its BC1/BC3 mip chain as .dds
+{
+    for (const char* file : TEXTURE_FILES)
+    {
+        std::string destination = CookedTexturePath(file);
+        CompressedImage cooked;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if (!CookTexture(file, destination.c_str(), &cooked))
+        {
+            cout << "Failed to cook texture " << file << endl;
+            return EXIT_FAILURE;
+        }
+        double cookMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        double uncompressed = cooked.width * cooked.height * 4.0 * 4.0 / 3.0; // RGBA8 with a driver generated mip chain
+        cout << "INFO: " << destination << " " << (cooked.format == BlockFormat::BC1 ? "BC1 " : "BC3 ") << cooked.width << "x" << cooked.height
+            << ", " << cooked.levels.size() << " mips, " << cooked.data.size() / 1024 << " KB (RGBA8 " << (size_t)uncompressed / 1024
+            << " KB, " << uncompressed / cooked.data.size() << "x smaller), cooked in " << cookMs << " ms" << endl;
+    }
+    return EXIT_SUCCESS;
+}
+int UBenchmarkNormalMatrices() // What moving the normal matrix out of the vertex shader saves, measured on the CPU
+{ // Under software GL (llvmpipe) the vertex shader runs on the CPU too, so the per-vertex inverse costs about what it costs here
+    const size_t objects = 100000;
+    const size_t verticesPerObject = 62; // The welded table mesh
+    std::vector<glm::mat4> models(objects);
+    std::vector<glm::mat3> normals(objects);
+    for (size_t i = 0; i < objects; i++)
+        models[i] = glm::translate(glm::vec3((float)i, 0.5f, -2.0f)) * glm::rotate(0.001f * i, glm::normalize(glm::vec3(1.0f, 2.0f, 3.0f))) * glm::scale(glm::vec3(1.0f + (i % 7), 2.0f, 0.5f));
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < objects; i++)
+        normals[i] = glm::mat3(glm::transpose(glm::inverse(models[i]))); // What the shader did, once per vertex
+    double shaderMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    float checksum = normals[objects / 2][1][1];
+    start = Clock::now();
+    for (size_t i = 0; i < objects; i++)
+        normals[i] = NormalMatrix(models[i]);
+    double scalarMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    start = Clock::now();
+    ComputeNormalMatrices(&models[0], sizeof(glm::mat4), &normals[0], sizeof(glm::mat3), objects);
+    double batchMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    double perVertexMs = shaderMs * verticesPerObject;
+    cout << "INFO: " << objects << " objects x " << verticesPerObject << " vertices: inverse per vertex " << perVertexMs << " ms"
+        << ", per object: mat4 inverse " << shaderMs << " ms, cofactor " << scalarMs << " ms, batched " << batchMs << " ms"
+        << " (check " << checksum - normals[objects / 2][1][1] << ")" << endl;
+    return EXIT_SUCCESS;
+}
+int UBenchmarkDrawQueue() // Binds and draw calls needed by a large random scene in submission order and after sorting, and what the sort costs
+{
+    const size_t objects = 10000;
+    const GLuint programs = 8, textures = 64, meshes = 16;
+    CommandList list;
+    DrawQueue queue;
+    queue.SetDepthRange(0.1f, 100.0f);
+    MeshAllocation ranges[meshes]; // Meshes suballocated from one pool: one VAO, different index ranges
+    for (GLuint m = 0; m < meshes; m++)
+    {
+        ranges[m].firstIndex = m * 36;
+        ranges[m].indexCount = 36;
+        ranges[m].baseVertex = (GLint)(m * 24);
+    }
+    unsigned int seed = 12345; // Fixed seed, every run measures the same scene
+    for (size_t i = 0; i < objects; i++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        GLuint program = 1 + (seed >> 8) % programs;
+        GLuint texture = 1 + (seed >> 12) % textures;
+        GLuint mesh = (seed >> 20) % meshes;
+        float depth = 0.1f + 99.9f * ((seed >> 4) & 0xffff) / 65535.0f;
+        queue.Add(DrawQueue::OPAQUE_PASS, program, texture, 1, depth, GL_TRIANGLES, ranges[mesh], 1, (GLuint)i);
+    }
+    std::vector<DrawItem> reference = queue.Items();
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    DrawQueue::Stats stats = queue.Flush(list); // Warm-up run sizes the sort buffers
+    double firstMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    const int runs = 100;
+    start = Clock::now();
+    for (int run = 0; run < runs; run++)
+    {
+        list.Reset();
+        queue.Flush(list);
+    }
+    double flushMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+    start = Clock::now();
+    for (int run = 0; run < runs; run++)
+    {
+        std::vector<DrawItem> sorted = reference;
+        std::sort(sorted.begin(), sorted.end(), [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+    }
+    double stdSortMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+    cout << "INFO: " << stats.draws << " draws (" << programs << " programs, " << textures << " textures, " << meshes << " pooled meshes): program/texture/VAO changes "
+        << stats.changesUnsorted << " unsorted, " << stats.changesSorted << " sorted, " << stats.submitted << " multi-draw calls for "
+        << stats.indirect << " indirect commands, " << list.commands.size() << " recorded commands" << endl;
+    cout << "INFO: radix sort + record " << flushMs << " ms per frame (first frame " << firstMs << " ms), std::sort alone " << stdSortMs << " ms" << endl;
+    return EXIT_SUCCESS;
+}
+int UBenchmarkCulling() // Frustum culling throughput on a large scattered scene, SSE batch against the scalar reference
+{
+    const size_t objects = 100000;
+    BoundsCuller culler;
+    Bounds unitCube = { glm::vec3(0.0f), glm::vec3(0.5f), std::sqrt(0.75f) };
+    unsigned int seed = 12345; // Fixed seed, every run measures the same scene
+    for (size_t i = 0; i < objects; i++)
+    {
+        float coordinates[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            coordinates[axis] = ((seed >> 8) & 0xffff) / 65535.0f * 200.0f - 100.0f;
+        }
+        glm::mat4 model = glm::translate(glm::vec3(coordinates[0], coordinates[1], coordinates[2])) * glm::rotate(0.01f * i, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::scale(glm::vec3(1.0f + (i % 5)));
+        culler.Add(TransformBounds(unitCube, model));
+    }
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 7.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)WINDOW_WIDTH / WINDOW_HEIGHT, 0.1f, 100.0f);
+    Frustum frustum = ExtractFrustum(projection * view);
+    std::vector<std::uint32_t> visible;
+    culler.Cull(frustum, visible); // Warm-up sizes the output
+    const int runs = 100;
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    for (int run = 0; run < runs; run++)
+        culler.Cull(frustum, visible);
+    double batchMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+    size_t scalarVisible = 0;
+    start = Clock::now();
+    for (int run = 0; run < runs; run++)
+    {
+        scalarVisible = 0;
+        for (size_t i = 0; i < objects; i++)
+            scalarVisible += culler.Visible(frustum, i);
+    }
+    double scalarMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+    cout << "INFO: " << objects << " objects, " << visible.size() << " visible (" << 100.0 * (objects - visible.size()) / objects << "% culled), scalar reference agrees: "
+        << (scalarVisible == visible.size() ? "yes" : "NO") << endl;
+    cout << "INFO: batch cull " << batchMs << " ms (" << batchMs * 1.0e6 / objects << " ns per object), scalar " << scalarMs << " ms" << endl;
+    return EXIT_SUCCESS;
+}
+int UBenchmarkOcclusion() // A wall in front of a grid of boxes: what rasterizing the occluder and testing the boxes costs, and how many it hides
+{
+    const int gridSide = 100; // 10000 unit boxes on a 100 x 100 grid behind the wall, all on screen, the outer ones beside the wall
+    const glm::vec3 wallPositions[] = { glm::vec3(-1.0f, -1.0f, 0.0f), glm::vec3(1.0f, -1.0f, 0.0f), glm::vec3(1.0f, 1.0f, 0.0f), glm::vec3(-1.0f, 1.0f, 0.0f) };
+    const unsigned int wallIndices[] = { 0, 1, 2, 2, 3, 0 };
+    glm::mat4 wallModel = glm::translate(glm::vec3(0.0f, 0.0f, -10.0f)) * glm::scale(glm::vec3(3.0f, 2.0f, 1.0f));
+    vector<Bounds> boxes;
+    Bounds unitCube = { glm::vec3(0.0f), glm::vec3(0.5f), std::sqrt(0.75f) };
+    for (int row = 0; row < gridSide; row++)
+        for (int column = 0; column < gridSide; column++)
+            boxes.push_back(TransformBounds(unitCube, glm::translate(glm::vec3((column - gridSide / 2) * 0.3f, (row - gridSide / 2) * 0.2f, -25.0f - (row + column) % 5))));
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)WINDOW_WIDTH / WINDOW_HEIGHT, 0.1f, 100.0f);
+    OcclusionBuffer buffer;
+    buffer.Create(320, 180);
+    const int runs = 100;
+    typedef std::chrono::steady_clock Clock;
+    double rasterMs = 0.0, testMs = 0.0;
+    size_t hidden = 0;
+    for (int run = 0; run < runs; run++)
+    {
+        Clock::time_point start = Clock::now();
+        buffer.Clear(projection * view);
+        buffer.RenderOccluder(wallPositions, 4, sizeof(glm::vec3), wallIndices, 6, wallModel);
+        buffer.Finish();
+        Clock::time_point rastered = Clock::now();
+        hidden = 0;
+        for (size_t i = 0; i < boxes.size(); i++)
+            hidden += !buffer.TestBounds(boxes[i]);
+        Clock::time_point tested = Clock::now();
+        rasterMs += std::chrono::duration<double, std::milli>(rastered - start).count();
+        testMs += std::chrono::duration<double, std::milli>(tested - rastered).count();
+    }
+    size_t inFront = 0; // Sanity check: a box in front of the wall must never be reported hidden
+    Bounds nearBox = TransformBounds(unitCube, glm::translate(glm::vec3(0.0f, 0.0f, -5.0f)));
+    inFront += buffer.TestBounds(nearBox);
+    // Nor may a box whose screen rectangle reaches past the wall's; the wall faces the camera, so its image is exactly a rectangle
+    glm::mat4 viewProjection = projection * view;
+    glm::vec2 wallLow(1e30f), wallHigh(-1e30f);
+    for (int i = 0; i < 4; i++)
+    {
+        glm::vec4 p = viewProjection * wallModel * glm::vec4(wallPositions[i], 1.0f);
+        wallLow = glm::min(wallLow, glm::vec2(p) / p.w);
+        wallHigh = glm::max(wallHigh, glm::vec2(p) / p.w);
+    }
+    size_t wronglyHidden = 0;
+    for (size_t i = 0; i < boxes.size(); i++)
+    {
+        if (buffer.TestBounds(boxes[i]))
+            continue;
+        glm::vec2 low(1e30f), high(-1e30f);
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec3 offset((corner & 1) ? boxes[i].extents.x : -boxes[i].extents.x, (corner & 2) ? boxes[i].extents.y : -boxes[i].extents.y, (corner & 4) ? boxes[i].extents.z : -boxes[i].extents.z);
+            glm::vec4 p = viewProjection * glm::vec4(boxes[i].center + offset, 1.0f);
+            low = glm::min(low, glm::vec2(p) / p.w);
+            high = glm::max(high, glm::vec2(p) / p.w);
+        }
+        bool onScreen = high.x >= -1.0f && low.x <= 1.0f && high.y >= -1.0f && low.y <= 1.0f; // Off screen counts as hidden
+        wronglyHidden += onScreen && (low.x < wallLow.x || low.y < wallLow.y || high.x > wallHigh.x || high.y > wallHigh.y);
+    }
+    cout << "INFO: " << buffer.Width() << "x" << buffer.Height() << " occlusion buffer, " << buffer.Triangles() << " occluder triangles, "
+        << hidden << " of " << boxes.size() << " boxes hidden (" << 100.0 * hidden / boxes.size() << "%), box in front of the wall visible: " << (inFront ? "yes" : "NO")
+        << ", hidden while peeking past the wall: " << wronglyHidden << endl;
+    cout << "INFO: clear + rasterize " << rasterMs / runs << " ms, box tests " << testMs / runs << " ms (" << testMs / runs * 1.0e6 / boxes.size() << " ns per box)" << endl;
+    return EXIT_SUCCESS;
+}
+int UBenchmarkBVH() // Build, refit, culling and picking over a large scattered scene, each checked against a brute-force answer
+{
+    const size_t objects = 100000;
+    vector<Bounds> bounds;
+    Bounds unitCube = { glm::vec3(0.0f), glm::vec3(0.5f), std::sqrt(0.75f) };
+    unsigned int seed = 12345; // Same scene as --bench-culling
+    for (size_t i = 0; i < objects; i++)
+    {
+        float coordinates[3];
+        for (int axis = 0; axis < 3; axis++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            coordinates[axis] = ((seed >> 8) & 0xffff) / 65535.0f * 200.0f - 100.0f;
+        }
+        glm::mat4 model = glm::translate(glm::vec3(coordinates[0], coordinates[1], coordinates[2])) * glm::rotate(0.01f * i, glm::vec3(0.0f, 1.0f, 0.0f)) * glm::scale(glm::vec3(1.0f + (i % 5)));
+        bounds.push_back(TransformBounds(unitCube, model));
+    }
+    typedef std::chrono::steady_clock Clock;
+    BVH bvh;
+    Clock::time_point start = Clock::now();
+    bvh.Build(&bounds[0], bounds.size());
+    double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    for (size_t i = 0; i < objects; i += 10) // Every tenth object moves a little, as animated objects would between frames
+        bounds[i].center += glm::vec3(0.25f, 0.0f, -0.25f);
+    start = Clock::now();
+    bvh.Refit(&bounds[0]);
+    double refitMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    // Culling: the hierarchy plus the SSE culler on straddling leaves, against the SSE culler on every object
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 7.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)WINDOW_WIDTH / WINDOW_HEIGHT, 0.1f, 100.0f);
+    Frustum frustum = ExtractFrustum(projection * view);
+    BoundsCuller everything, straddling;
+    for (size_t i = 0; i < objects; i++)
+        everything.Add(bounds[i]);
+    vector<std::uint32_t> expected, visible, partial, partialVisible;
+    const int runs = 100;
+    start = Clock::now();
+    for (int run = 0; run < runs; run++)
+        everything.Cull(frustum, expected);
+    double flatMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+    start = Clock::now();
+    for (int run = 0; run < runs; run++)
+    {
+        bvh.Cull(frustum, visible, partial);
+        straddling.Clear();
+        for (size_t i = 0; i < partial.size(); i++)
+            straddling.Add(bounds[partial[i]]);
+        straddling.Cull(frustum, partialVisible);
+        for (size_t i = 0; i < partialVisible.size(); i++)
+            visible.push_back(partial[partialVisible[i]]);
+    }
+    double hierarchyMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+    size_t accepted = visible.size() - partialVisible.size();
+    std::sort(visible.begin(), visible.end());
+    // Picking: rays from the camera towards random points, against a loop over every box
+    const int rays = 1000;
+    int agree = 0, hits = 0;
+    double pickMs = 0.0;
+    for (int r = 0; r < rays; r++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        Ray ray;
+        ray.origin = glm::vec3(0.0f, 0.0f, 7.0f);
+        ray.direction = glm::vec3(((seed >> 8) & 0xff) / 255.0f * 100.0f - 50.0f, ((seed >> 16) & 0xff) / 255.0f * 100.0f - 50.0f, -100.0f);
+        std::uint32_t object = 0;
+        float distance = 0.0f;
+        start = Clock::now();
+        bool hit = bvh.Pick(ray, 1.0f, object, distance);
+        pickMs += std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        float nearest = 1.0f; // Brute force slab test of every object
+        bool bruteHit = false;
+        for (size_t i = 0; i < objects; i++)
+        {
+            glm::vec3 t0 = (bounds[i].center - bounds[i].extents - ray.origin) / ray.direction, t1 = (bounds[i].center + bounds[i].extents - ray.origin) / ray.direction;
+            glm::vec3 closer = glm::min(t0, t1), farther = glm::max(t0, t1);
+            float enter = std::max(std::max(closer.x, closer.y), std::max(closer.z, 0.0f)), exit = std::min(std::min(farther.x, farther.y), std::min(farther.z, nearest));
+            if (enter <= exit)
+            {
+                nearest = enter;
+                bruteHit = true;
+            }
+        }
+        hits += hit;
+        agree += hit == bruteHit && (!hit || distance == nearest);
+    }
+    // Region query: a 20-unit box around the origin
+    vector<std::uint32_t> found;
+    bvh.Query(glm::vec3(-10.0f), glm::vec3(10.0f), found);
+    size_t bruteFound = 0;
+    for (size_t i = 0; i < objects; i++)
+        bruteFound += glm::all(glm::lessThanEqual(bounds[i].center - bounds[i].extents, glm::vec3(10.0f))) && glm::all(glm::greaterThanEqual(bounds[i].center + bounds[i].extents, glm::vec3(-10.0f)));
+    cout << "INFO: " << objects << " objects, " << bvh.Nodes().size() << " nodes, SAH build " << buildMs << " ms, refit " << refitMs << " ms" << endl;
+    cout << "INFO: frustum cull " << hierarchyMs << " ms through the hierarchy (" << accepted << " accepted whole, " << partial.size() << " tested one by one) against "
+        << flatMs << " ms testing every object, same visible set: " << (visible == expected ? "yes" : "NO") << " (" << visible.size() << ")" << endl;
+    cout << "INFO: " << rays << " picks, " << hits << " hits, " << pickMs * 1000.0 / rays << " us per pick, agree with brute force: " << agree << " of " << rays << endl;
+    cout << "INFO: box query found " << found.size() << " objects, brute force " << bruteFound << endl;
+    return EXIT_SUCCESS;
+}
+int UBenchmarkLod() // LOD chain of a dense sphere: triangles and error per level, generation time, and the level each distance selects
+{
+    vector<glm::vec3> positions;
+    vector<unsigned int> indices;
+    UBuildSphere(128, 256, positions, indices); // 65024 triangles
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    vector<MeshLod> lods = GenerateLodChain(indices, &positions[0], positions.size(), sizeof(glm::vec3), 0, 6);
+    double generateMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    cout << "INFO: " << positions.size() << " vertices, " << lods.size() << " levels generated in " << generateMs << " ms, all sharing the vertex buffer" << endl;
+    for (size_t i = 0; i < lods.size(); i++)
+    {
+        float worst = 0.0f; // Measured error: how far the level's vertices sit from the true sphere is 0, so check its face centers
+        for (unsigned int t = lods[i].firstIndex; t < lods[i].firstIndex + lods[i].indexCount; t += 3)
+            worst = std::max(worst, 1.0f - glm::length((positions[indices[t]] + positions[indices[t + 1]] + positions[indices[t + 2]]) / 3.0f));
+        cout << "INFO: level " << i << ": " << lods[i].indexCount / 3 << " triangles, error bound " << lods[i].error << ", deepest face center " << worst << " inside the sphere" << endl;
+    }
+    const float distances[] = { 2.0f, 5.0f, 10.0f, 25.0f, 50.0f, 100.0f };
+    for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++)
+    {
+        size_t lod = SelectLod(lods, 1.0f, distances[i], glm::radians(45.0f), 1080.0f);
+        cout << "INFO: unit sphere at " << distances[i] << " units on a 1080-pixel-tall 45 degree view: level " << lod << ", "
+            << 100.0f * lods[lod].indexCount / lods[0].indexCount << "% of the triangles" << endl;
+    }
+    return EXIT_SUCCESS;
+}
+void UBuildSphere(int rings, int segments, vector<glm::vec3>& positions, vector<unsigned int>& indices) // Unit UV sphere, welded so only the poles are shared fans
+{
+    positions.clear();
+    indices.clear();
+    positions.push_back(glm::vec3(0.0f, 1.0f, 0.0f));
+    for (int ring = 1; ring < rings; ring++)
+        for (int segment = 0; segment < segments; segment++)
+        {
+            float theta = glm::pi<float>() * ring / rings, phi = glm::two_pi<float>() * segment / segments;
+            positions.push_back(glm::vec3(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi)));
+        }
+    positions.push_back(glm::vec3(0.0f, -1.0f, 0.0f));
+    const unsigned int south = (unsigned int)positions.size() - 1;
+    for (int ring = 0; ring < rings; ring++)
+        for (int segment = 0; segment < segments; segment++)
+        {
+            int next = (segment + 1) % segments;
+            unsigned int a = ring == 0 ? 0 : 1 + (ring - 1) * segments + segment, b = ring == 0 ? 0 : 1 + (ring - 1) * segments + next;
+            unsigned int c = ring == rings - 1 ? south : 1 + ring * segments + segment, d = ring == rings - 1 ? south : 1 + ring * segments + next;
+            if (ring != 0) // Counter-clockwise seen from outside
+            {
+                indices.push_back(a); indices.push_back(b); indices.push_back(c);
+            }
+            if (ring != rings - 1)
+            {
+                indices.push_back(b); indices.push_back(d); indices.push_back(c);
+            }
+        }
+}
+int UBenchmarkMeshlets() // Meshlets of a dense sphere, and what per-cluster culling leaves to draw from a close camera
+{
+    vector<glm::vec3> positions;
+    vector<unsigned int> indices;
+    UBuildSphere(128, 256, positions, indices); // 65024 triangles
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    vector<Meshlet> meshlets = BuildMeshlets(indices, &positions[0], positions.size(), sizeof(glm::vec3));
+    double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    size_t vertexSum = 0, triangleSum = 0, withCone = 0;
+    for (size_t m = 0; m < meshlets.size(); m++)
+    {
+        vertexSum += meshlets[m].vertexCount;
+        triangleSum += meshlets[m].indexCount / 3;
+        withCone += meshlets[m].coneCutoff <= 1.0f;
+    }
+    cout << "INFO: " << triangleSum << " triangles in " << meshlets.size() << " meshlets built in " << buildMs << " ms, " << (float)vertexSum / meshlets.size() << " vertices and "
+        << (float)triangleSum / meshlets.size() << " triangles on average, " << withCone << " with a usable normal cone" << endl;
+    // A camera 2.5 units from the sphere's center sees part of the near side; everything else is behind it or off screen
+    glm::vec3 eye(0.0f, 0.0f, 2.5f);
+    glm::mat4 view = glm::lookAt(eye, glm::vec3(0.6f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)WINDOW_WIDTH / WINDOW_HEIGHT, 0.1f, 100.0f);
+    Frustum frustum = ExtractFrustum(projection * view);
+    glm::mat4 model(1.0f);
+    const int runs = 1000;
+    size_t frustumOnly = 0, drawn = 0, drawnTriangles = 0;
+    start = Clock::now();
+    for (int run = 0; run < runs; run++)
+    {
+        drawn = 0;
+        drawnTriangles = 0;
+        for (size_t m = 0; m < meshlets.size(); m++)
+            if (MeshletVisible(meshlets[m], model, 1.0f, frustum, eye, true))
+            {
+                drawn++;
+                drawnTriangles += meshlets[m].indexCount / 3;
+            }
+    }
+    double cullUs = std::chrono::duration<double, std::micro>(Clock::now() - start).count() / runs;
+    for (size_t m = 0; m < meshlets.size(); m++)
+        frustumOnly += MeshletVisible(meshlets[m], model, 1.0f, frustum, eye, false);
+    size_t wronglyCulled = 0; // A culled cluster must have no triangle facing the eye with a vertex on screen
+    glm::mat4 viewProjection = projection * view;
+    for (size_t m = 0; m < meshlets.size(); m++)
+    {
+        if (MeshletVisible(meshlets[m], model, 1.0f, frustum, eye, true))
+            continue;
+        for (unsigned int t = meshlets[m].firstIndex; t < meshlets[m].firstIndex + meshlets[m].indexCount; t += 3)
+        {
+            glm::vec3 p0 = positions[indices[t]], p1 = positions[indices[t + 1]], p2 = positions[indices[t + 2]];
+            bool facing = glm::dot(glm::cross(p1 - p0, p2 - p0), eye - p0) > 0.0f;
+            glm::vec4 clip = viewProjection * glm::vec4(p0, 1.0f);
+            bool onScreen = clip.w > 0.0f && std::fabs(clip.x) <= clip.w && std::fabs(clip.y) <= clip.w && std::fabs(clip.z) <= clip.w;
+            if (facing && onScreen)
+            {
+                wronglyCulled++;
+                break;
+            }
+        }
+    }
+    cout << "INFO: close camera: " << frustumOnly << " meshlets in the frustum, " << drawn << " also facing the camera, "
+        << drawnTriangles << " triangles drawn (" << 100.0f * drawnTriangles / triangleSum << "%), culling " << cullUs << " us per frame, wrongly culled: " << wronglyCulled << endl;
+    return EXIT_SUCCESS;
+}
+void UScatterLights(int count, float extent, vector<ClusterLight>& lights) // Small colored lamps over [-extent, extent] around the table, 1 to 2 units of reach each
+{
+    unsigned int seed = 24680; // Fixed seed, every run places the same lights
+    for (int i = 0; i < count; i++)
+    {
+        float random[5];
+        for (int k = 0; k < 5; k++)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            random[k] = ((seed >> 8) & 0xffff) / 65535.0f;
+        }
+        glm::vec3 position((random[0] * 2.0f - 1.0f) * extent, random[1] * 4.0f - 1.0f, (random[2] * 2.0f - 1.0f) * extent);
+        float hue = random[3] * 6.0f; // Saturated color around the hue circle
+        glm::vec3 color = glm::clamp(glm::vec3(std::fabs(hue - 3.0f) - 1.0f, 2.0f - std::fabs(hue - 2.0f), 2.0f - std::fabs(hue - 4.0f)), 0.0f, 1.0f) * 0.6f;
+        ClusterLight light;
+        light.positionRange = glm::vec4(position, 1.0f + random[4]);
+        light.color = glm::vec4(color, 1.0f);
+        light.shading = glm::vec4(0.5f, 16.0f, 0.0f, 0.0f);
+        lights.push_back(light);
+    }
+}
+int UBenchmarkLights() // Froxel binning cost and the light list lengths fragments loop over, as the light count grows
+{
+    glm::vec3 eye(0.0f, 2.0f, 7.0f);
+    glm::mat4 view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, -10.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), (float)WINDOW_WIDTH / WINDOW_HEIGHT, 0.1f, 100.0f);
+    glm::mat4 viewProjection = projection * view;
+    typedef std::chrono::steady_clock Clock;
+    const int counts[] = { 256, 1024, 4096 };
+    for (int c = 0; c < 3; c++)
+    {
+        LightClusters clusters;
+        UScatterLights(counts[c], 40.0f, clusters.lights); // Over the same 80 x 80 area, so the lights get denser
+        const int runs = 20;
+        Clock::time_point start = Clock::now();
+        for (int run = 0; run < runs; run++)
+            clusters.Build(view, projection, 0.1f, 100.0f, WINDOW_WIDTH, WINDOW_HEIGHT);
+        double buildMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+        size_t occupied = 0;
+        for (size_t i = 0; i < clusters.clusters.size(); i++)
+            occupied += clusters.clusters[i].y > 0;
+        // Fragments: random points on screen inside the lit volume. Each must find every light that reaches it in its froxel's list
+        unsigned int seed = 13579;
+        size_t samples = 0, listed = 0, reaching = 0, missed = 0;
+        while (samples < 100000)
+        {
+            float random[3];
+            for (int k = 0; k < 3; k++)
+            {
+                seed = seed * 1664525u + 1013904223u;
+                random[k] = ((seed >> 8) & 0xffff) / 65535.0f;
+            }
+            glm::vec3 point((random[0] * 2.0f - 1.0f) * 40.0f, random[1] * 4.0f - 1.0f, (random[2] * 2.0f - 1.0f) * 40.0f);
+            glm::vec4 clip = viewProjection * glm::vec4(point, 1.0f);
+            if (clip.w <= 0.1f || std::fabs(clip.x) >= clip.w || std::fabs(clip.y) >= clip.w)
+                continue;
+            samples++;
+            float x = (clip.x / clip.w * 0.5f + 0.5f) * WINDOW_WIDTH, y = (clip.y / clip.w * 0.5f + 0.5f) * WINDOW_HEIGHT;
+            glm::uvec2 range = clusters.clusters[clusters.ClusterAt(x, y, -(view * glm::vec4(point, 1.0f)).z)];
+            listed += range.y;
+            for (size_t l = 0; l < clusters.lights.size(); l++)
+            {
+                const glm::vec4& light = clusters.lights[l].positionRange;
+                if (glm::length(glm::vec3(light) - point) >= light.w)
+                    continue;
+                reaching++;
+                missed += std::find(clusters.indices.begin() + range.x, clusters.indices.begin() + range.x + range.y, (GLuint)l) == clusters.indices.begin() + range.x + range.y;
+            }
+        }
+        cout << "INFO: " << counts[c] << " lights binned into " << LightClusters::CLUSTERS << " froxels in " << buildMs << " ms, " << occupied << " froxels lit, "
+            << (float)clusters.indices.size() / std::max(occupied, (size_t)1) << " lights per lit froxel on average, at most " << clusters.MaxLightsPerCluster() << endl;
+        cout << "INFO: " << counts[c] << " lights: fragments loop over " << (float)listed / samples << " lights on average instead of " << counts[c] << ", "
+            << (float)reaching / samples << " of them reach the fragment, missed: " << missed << endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,331 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <glm/glm.hpp>
+
+#include "culling.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// A ray for picking, direction need not be unit length; hit distances are in multiples of it
+struct Ray
+{
+	glm::vec3 origin;
+	glm::vec3 direction;
+};
+
+// Bounding volume hierarchy over object bounds: picks, box queries and frustum culling visit
+// O(log n) nodes instead of every object. Build() splits top-down with a binned surface area
+// heuristic; Refit() keeps the tree and only recomputes boxes bottom-up, which is all moving
+// objects need as long as they do not travel far from where they were at the last Build().
+// Object indices are the positions in the array given to Build().
+class BVH
+{
+public:
+	static const int BINS = 12;
+	static const int MAX_LEAF_OBJECTS = 4;
+
+	struct Node
+	{
+		glm::vec3 low, high;
+		std::uint32_t left; // first child, the second is left + 1; 0 for a leaf (the root is never a child)
+		std::uint32_t start; // the node's objects are objects[start, start + count), leaf or not
+		std::uint32_t count;
+	};
+
+	// ------------------------------------------------------------------------
+	void Build(const Bounds* bounds, size_t count)
+	{
+		nodes.clear();
+		objects.resize(count);
+		centroids.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			objects[i] = (std::uint32_t)i;
+			centroids[i] = bounds[i].center;
+		}
+		if (count == 0)
+			return;
+		nodes.reserve(2 * count);
+		Node root = { glm::vec3(0.0f), glm::vec3(0.0f), 0, 0, (std::uint32_t)count };
+		nodes.push_back(root);
+		std::vector<std::uint32_t> pending(1, 0);
+		while (!pending.empty())
+		{
+			std::uint32_t index = pending.back();
+			pending.pop_back();
+			Fit(nodes[index], bounds);
+			std::uint32_t middle;
+			if (nodes[index].count <= 1 || !Split(nodes[index], middle))
+				continue;
+			Node left = { glm::vec3(0.0f), glm::vec3(0.0f), 0, nodes[index].start, middle - nodes[index].start };
+			Node right = { glm::vec3(0.0f), glm::vec3(0.0f), 0, middle, nodes[index].start + nodes[index].count - middle };
+			nodes[index].left = (std::uint32_t)nodes.size();
+			nodes.push_back(left);
+			nodes.push_back(right);
+			pending.push_back(nodes[index].left);
+			pending.push_back(nodes[index].left + 1);
+		}
+	}
+	// new bounds for the same objects; children always come after their parent, so one reverse pass fits every node
+	// ------------------------------------------------------------------------
+	void Refit(const Bounds* bounds)
+	{
+		for (size_t i = nodes.size(); i-- > 0;)
+		{
+			Node& node = nodes[i];
+			if (node.left == 0)
+				Fit(node, bounds);
+			else
+			{
+				node.low = glm::min(nodes[node.left].low, nodes[node.left + 1].low);
+				node.high = glm::max(nodes[node.left].high, nodes[node.left + 1].high);
+			}
+		}
+	}
+	// nearest object whose box the ray enters at a distance in [0, maxDistance], false when there is none
+	// ------------------------------------------------------------------------
+	bool Pick(const Ray& ray, float maxDistance, std::uint32_t& object, float& distance) const
+	{
+		if (nodes.empty())
+			return false;
+		glm::vec3 inverse = 1.0f / ray.direction; // +-infinity on axes the ray is parallel to, the slab test copes
+		float best = maxDistance;
+		bool hit = false;
+		std::vector<std::uint32_t>& pending = scratch;
+		pending.assign(1, 0);
+		while (!pending.empty())
+		{
+			const Node& node = nodes[pending.back()];
+			pending.pop_back();
+			float entry;
+			if (!Slab(ray.origin, inverse, node.low, node.high, best, entry))
+				continue;
+			if (node.left == 0)
+			{
+				for (std::uint32_t i = node.start; i < node.start + node.count; i++)
+				{
+					glm::vec3 low = boxes[objects[i]].low, high = boxes[objects[i]].high;
+					if (Slab(ray.origin, inverse, low, high, best, entry))
+					{
+						best = entry;
+						object = objects[i];
+						hit = true;
+					}
+				}
+				continue;
+			}
+			// visit the nearer child first, it usually shortens the ray for the other
+			float leftEntry = 0.0f, rightEntry = 0.0f;
+			bool leftHit = Slab(ray.origin, inverse, nodes[node.left].low, nodes[node.left].high, best, leftEntry);
+			bool rightHit = Slab(ray.origin, inverse, nodes[node.left + 1].low, nodes[node.left + 1].high, best, rightEntry);
+			if (leftHit && rightHit)
+			{
+				pending.push_back(leftEntry < rightEntry ? node.left + 1 : node.left);
+				pending.push_back(leftEntry < rightEntry ? node.left : node.left + 1);
+			}
+			else if (leftHit)
+				pending.push_back(node.left);
+			else if (rightHit)
+				pending.push_back(node.left + 1);
+		}
+		distance = best;
+		return hit;
+	}
+	// append every object whose box overlaps [low, high]
+	// ------------------------------------------------------------------------
+	void Query(const glm::vec3& low, const glm::vec3& high, std::vector<std::uint32_t>& found) const
+	{
+		if (nodes.empty())
+			return;
+		std::vector<std::uint32_t>& pending = scratch;
+		pending.assign(1, 0);
+		while (!pending.empty())
+		{
+			const Node& node = nodes[pending.back()];
+			pending.pop_back();
+			if (!Overlaps(node.low, node.high, low, high))
+				continue;
+			if (node.left != 0)
+			{
+				pending.push_back(node.left);
+				pending.push_back(node.left + 1);
+				continue;
+			}
+			for (std::uint32_t i = node.start; i < node.start + node.count; i++)
+				if (Overlaps(boxes[objects[i]].low, boxes[objects[i]].high, low, high))
+					found.push_back(objects[i]);
+		}
+	}
+	// hierarchical frustum test: objects under a node fully inside the frustum go to inside without
+	// another test, objects of leaves that straddle a plane go to partial for a finer per-object test
+	// (BoundsCuller), nodes fully outside any plane are skipped with everything under them
+	// ------------------------------------------------------------------------
+	void Cull(const Frustum& frustum, std::vector<std::uint32_t>& inside, std::vector<std::uint32_t>& partial) const
+	{
+		inside.clear();
+		partial.clear();
+		if (nodes.empty())
+			return;
+		std::vector<std::uint32_t>& pending = scratch;
+		pending.assign(1, 0);
+		while (!pending.empty())
+		{
+			const Node& node = nodes[pending.back()];
+			pending.pop_back();
+			glm::vec3 center = (node.low + node.high) * 0.5f, extents = (node.high - node.low) * 0.5f;
+			bool straddles = false, outside = false;
+			for (int p = 0; p < 6 && !outside; p++)
+			{
+				const glm::vec4& plane = frustum.planes[p];
+				float distance = glm::dot(glm::vec3(plane), center) + plane.w;
+				float reach = glm::dot(glm::abs(glm::vec3(plane)), extents);
+				outside = distance + reach < 0.0f;
+				straddles = straddles || distance - reach < 0.0f;
+			}
+			if (outside)
+				continue;
+			std::vector<std::uint32_t>& output = straddles ? partial : inside;
+			if (straddles && node.left != 0)
+			{
+				pending.push_back(node.left);
+				pending.push_back(node.left + 1);
+				continue;
+			}
+			output.insert(output.end(), objects.begin() + node.start, objects.begin() + node.start + node.count);
+		}
+	}
+	const std::vector<Node>& Nodes() const
+	{
+		return nodes;
+	}
+	size_t ObjectCount() const
+	{
+		return objects.size();
+	}
+
+private:
+	struct Box
+	{
+		glm::vec3 low, high;
+	};
+
+	std::vector<Node> nodes;
+	std::vector<std::uint32_t> objects; // object indices, reordered so every node's objects are contiguous
+	std::vector<glm::vec3> centroids;
+	std::vector<Box> boxes; // per object, refreshed by Build() and Refit()
+	mutable std::vector<std::uint32_t> scratch;
+
+	void Fit(Node& node, const Bounds* bounds)
+	{
+		if (boxes.size() != objects.size())
+			boxes.resize(objects.size());
+		node.low = glm::vec3(1e30f);
+		node.high = glm::vec3(-1e30f);
+		for (std::uint32_t i = node.start; i < node.start + node.count; i++)
+		{
+			const Bounds& b = bounds[objects[i]];
+			Box& box = boxes[objects[i]];
+			box.low = b.center - b.extents;
+			box.high = b.center + b.extents;
+			node.low = glm::min(node.low, box.low);
+			node.high = glm::max(node.high, box.high);
+		}
+	}
+	static float HalfArea(const glm::vec3& low, const glm::vec3& high)
+	{
+		glm::vec3 size = high - low;
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+	// binned SAH over the axis of the widest centroid spread; false when a leaf is cheaper
+	bool Split(const Node& node, std::uint32_t& middle)
+	{
+		std::uint32_t first = node.start, last = node.start + node.count;
+		glm::vec3 low(1e30f), high(-1e30f);
+		for (std::uint32_t i = first; i < last; i++)
+		{
+			low = glm::min(low, centroids[objects[i]]);
+			high = glm::max(high, centroids[objects[i]]);
+		}
+		glm::vec3 spread = high - low;
+		int axis = spread.x > spread.y ? (spread.x > spread.z ? 0 : 2) : (spread.y > spread.z ? 1 : 2);
+		if (spread[axis] <= 0.0f) // every centroid in one place: split by count if the leaf is too big
+		{
+			if (node.count <= MAX_LEAF_OBJECTS)
+				return false;
+			middle = first + node.count / 2;
+			return true;
+		}
+		struct Bin
+		{
+			glm::vec3 low = glm::vec3(1e30f), high = glm::vec3(-1e30f);
+			std::uint32_t count = 0;
+		};
+		Bin bins[BINS];
+		float scale = BINS / spread[axis];
+		for (std::uint32_t i = first; i < last; i++)
+		{
+			int bin = std::min(BINS - 1, (int)((centroids[objects[i]][axis] - low[axis]) * scale));
+			bins[bin].count++;
+			bins[bin].low = glm::min(bins[bin].low, boxes[objects[i]].low);
+			bins[bin].high = glm::max(bins[bin].high, boxes[objects[i]].high);
+		}
+		// cost of splitting after bin i: area-weighted counts left and right, swept from both ends
+		float rightCost[BINS];
+		glm::vec3 sweepLow(1e30f), sweepHigh(-1e30f);
+		std::uint32_t sweepCount = 0;
+		for (int i = BINS - 1; i > 0; i--)
+		{
+			sweepCount += bins[i].count;
+			sweepLow = glm::min(sweepLow, bins[i].low);
+			sweepHigh = glm::max(sweepHigh, bins[i].high);
+			rightCost[i] = sweepCount ? sweepCount * HalfArea(sweepLow, sweepHigh) : 0.0f;
+		}
+		float bestCost = 1e30f;
+		int bestBin = -1;
+		sweepLow = glm::vec3(1e30f);
+		sweepHigh = glm::vec3(-1e30f);
+		sweepCount = 0;
+		for (int i = 0; i < BINS - 1; i++)
+		{
+			sweepCount += bins[i].count;
+			sweepLow = glm::min(sweepLow, bins[i].low);
+			sweepHigh = glm::max(sweepHigh, bins[i].high);
+			if (sweepCount == 0 || sweepCount == node.count)
+				continue;
+			float cost = sweepCount * HalfArea(sweepLow, sweepHigh) + rightCost[i + 1];
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestBin = i;
+			}
+		}
+		// a traversal step costs about as much as one object test
+		float leafCost = node.count * HalfArea(node.low, node.high);
+		if (bestBin < 0 || (node.count <= MAX_LEAF_OBJECTS && bestCost + HalfArea(node.low, node.high) >= leafCost))
+			return false;
+		std::uint32_t* split = std::partition(&objects[0] + first, &objects[0] + last, [&](std::uint32_t object)
+			{
+				return std::min(BINS - 1, (int)((centroids[object][axis] - low[axis]) * scale)) <= bestBin;
+			});
+		middle = (std::uint32_t)(split - &objects[0]);
+		return true;
+	}
+	static bool Overlaps(const glm::vec3& lowA, const glm::vec3& highA, const glm::vec3& lowB, const glm::vec3& highB)
+	{
+		return lowA.x <= highB.x && highA.x >= lowB.x && lowA.y <= highB.y && highA.y >= lowB.y && lowA.z <= highB.z && highA.z >= lowB.z;
+	}
+	// entry distance of the ray into the box when it is within [0, maxDistance]
+	static bool Slab(const glm::vec3& origin, const glm::vec3& inverse, const glm::vec3& low, const glm::vec3& high, float maxDistance, float& entry)
+	{
+		glm::vec3 t0 = (low - origin) * inverse, t1 = (high - origin) * inverse;
+		glm::vec3 closer = glm::min(t0, t1), farther = glm::max(t0, t1); // not near/far, windows.h defines those
+		float enter = std::max(std::max(closer.x, closer.y), std::max(closer.z, 0.0f));
+		float exit = std::min(std::min(farther.x, farther.y), std::min(farther.z, maxDistance));
+		entry = enter;
+		return enter <= exit;
+	}
+};
+#endif
@@ -0,0 +1,189 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define CULLING_SSE
+#include <xmmintrin.h>
+#endif
+
+// Bounding volume of a mesh or object: an axis-aligned box (center +- extents) and a sphere around
+// the same center. Both are conservative, the culler uses whichever is tighter against each plane.
+struct Bounds
+{
+	glm::vec3 center;
+	glm::vec3 extents;
+	float radius;
+};
+
+// bounds of positions read with a byte stride, e.g. &vertices[0].Position and sizeof(Vertex)
+inline Bounds ComputeBounds(const glm::vec3* positions, size_t count, size_t stride)
+{
+	Bounds bounds = { glm::vec3(0.0f), glm::vec3(0.0f), 0.0f };
+	if (count == 0)
+		return bounds;
+	const unsigned char* source = (const unsigned char*)positions;
+	glm::vec3 low = *positions, high = *positions;
+	for (size_t i = 1; i < count; i++)
+	{
+		const glm::vec3& p = *(const glm::vec3*)(source + i * stride);
+		low = glm::min(low, p);
+		high = glm::max(high, p);
+	}
+	bounds.center = (low + high) * 0.5f;
+	bounds.extents = (high - low) * 0.5f;
+	float radiusSquared = 0.0f; // around the box center, never larger than the half diagonal
+	for (size_t i = 0; i < count; i++)
+	{
+		glm::vec3 offset = *(const glm::vec3*)(source + i * stride) - bounds.center;
+		radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+	}
+	bounds.radius = std::sqrt(radiusSquared);
+	return bounds;
+}
+
+// world-space bounds of an object: the box is re-fitted around the rotated box (Arvo), the sphere
+// is scaled by the largest axis scale
+inline Bounds TransformBounds(const Bounds& local, const glm::mat4& model)
+{
+	Bounds world;
+	world.center = glm::vec3(model * glm::vec4(local.center, 1.0f));
+	glm::mat3 axes(model);
+	world.extents = glm::abs(axes[0]) * local.extents.x + glm::abs(axes[1]) * local.extents.y + glm::abs(axes[2]) * local.extents.z;
+	float scale = std::sqrt(std::max(glm::dot(axes[0], axes[0]), std::max(glm::dot(axes[1], axes[1]), glm::dot(axes[2], axes[2]))));
+	world.radius = local.radius * scale;
+	return world;
+}
+
+// The six planes of a view frustum, normals pointing inwards: a point p is inside a plane when
+// dot(plane.xyz, p) + plane.w >= 0, and plane.xyz is unit length so that value is a distance.
+struct Frustum
+{
+	glm::vec4 planes[6]; // left, right, bottom, top, near, far
+};
+
+// Gribb/Hartmann extraction from projection * view; the planes come out in world space
+inline Frustum ExtractFrustum(const glm::mat4& viewProjection)
+{
+	glm::vec4 row[4];
+	for (int r = 0; r < 4; r++)
+		row[r] = glm::vec4(viewProjection[0][r], viewProjection[1][r], viewProjection[2][r], viewProjection[3][r]);
+	Frustum frustum;
+	frustum.planes[0] = row[3] + row[0];
+	frustum.planes[1] = row[3] - row[0];
+	frustum.planes[2] = row[3] + row[1];
+	frustum.planes[3] = row[3] - row[1];
+	frustum.planes[4] = row[3] + row[2];
+	frustum.planes[5] = row[3] - row[2];
+	for (int i = 0; i < 6; i++)
+		frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+	return frustum;
+}
+
+// Frustum culler for many objects at once. World bounds are stored as structure of arrays so that
+// with SSE four objects are tested against a plane with a handful of vector instructions; an object
+// is culled when it lies fully outside any one plane. Add() every object, then Cull().
+class BoundsCuller
+{
+public:
+	// ------------------------------------------------------------------------
+	void Clear()
+	{
+		centerX.clear();
+		centerY.clear();
+		centerZ.clear();
+		extentX.clear();
+		extentY.clear();
+		extentZ.clear();
+		radius.clear();
+	}
+	// returns the index Cull() reports the object by
+	// ------------------------------------------------------------------------
+	std::uint32_t Add(const Bounds& world)
+	{
+		centerX.push_back(world.center.x);
+		centerY.push_back(world.center.y);
+		centerZ.push_back(world.center.z);
+		extentX.push_back(world.extents.x);
+		extentY.push_back(world.extents.y);
+		extentZ.push_back(world.extents.z);
+		radius.push_back(world.radius);
+		return (std::uint32_t)radius.size() - 1;
+	}
+	size_t Count() const
+	{
+		return radius.size();
+	}
+	// fill visible with the indices of the objects that may be on screen, in ascending order, and return their count
+	// ------------------------------------------------------------------------
+	size_t Cull(const Frustum& frustum, std::vector<std::uint32_t>& visible) const
+	{
+		size_t count = radius.size();
+		visible.resize(count);
+		size_t visibleCount = 0, i = 0;
+#ifdef CULLING_SSE
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		__m128 planeX[6], planeY[6], planeZ[6], planeW[6], absX[6], absY[6], absZ[6];
+		for (int p = 0; p < 6; p++)
+		{
+			planeX[p] = _mm_set1_ps(frustum.planes[p].x);
+			planeY[p] = _mm_set1_ps(frustum.planes[p].y);
+			planeZ[p] = _mm_set1_ps(frustum.planes[p].z);
+			planeW[p] = _mm_set1_ps(frustum.planes[p].w);
+			absX[p] = _mm_andnot_ps(signMask, planeX[p]);
+			absY[p] = _mm_andnot_ps(signMask, planeY[p]);
+			absZ[p] = _mm_andnot_ps(signMask, planeZ[p]);
+		}
+		for (; i + 4 <= count; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(&centerX[i]), y = _mm_loadu_ps(&centerY[i]), z = _mm_loadu_ps(&centerZ[i]);
+			__m128 ex = _mm_loadu_ps(&extentX[i]), ey = _mm_loadu_ps(&extentY[i]), ez = _mm_loadu_ps(&extentZ[i]);
+			__m128 r = _mm_loadu_ps(&radius[i]);
+			__m128 outside = _mm_setzero_ps();
+			for (int p = 0; p < 6; p++)
+			{
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planeX[p], x), _mm_mul_ps(planeY[p], y)), _mm_add_ps(_mm_mul_ps(planeZ[p], z), planeW[p]));
+				__m128 boxRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(absX[p], ex), _mm_mul_ps(absY[p], ey)), _mm_mul_ps(absZ[p], ez));
+				__m128 reach = _mm_min_ps(r, boxRadius);
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+			}
+			int inside = ~_mm_movemask_ps(outside) & 0xf;
+			for (int lane = 0; lane < 4; lane++)
+				if (inside & (1 << lane))
+					visible[visibleCount++] = (std::uint32_t)(i + lane);
+		}
+#endif
+		for (; i < count; i++)
+			if (Visible(frustum, i))
+				visible[visibleCount++] = (std::uint32_t)i;
+		visible.resize(visibleCount);
+		return visibleCount;
+	}
+	// the per-object test Cull() vectorizes, also the reference it is checked against
+	// ------------------------------------------------------------------------
+	bool Visible(const Frustum& frustum, size_t i) const
+	{
+		for (int p = 0; p < 6; p++)
+		{
+			const glm::vec4& plane = frustum.planes[p];
+			float distance = (plane.x * centerX[i] + plane.y * centerY[i]) + (plane.z * centerZ[i] + plane.w); // same order as the SSE path
+			float boxRadius = std::fabs(plane.x) * extentX[i] + std::fabs(plane.y) * extentY[i] + std::fabs(plane.z) * extentZ[i];
+			if (distance + std::min(radius[i], boxRadius) < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+private:
+	std::vector<float> centerX, centerY, centerZ;
+	std::vector<float> extentX, extentY, extentZ;
+	std::vector<float> radius;
+};
+#endif
@@ -0,0 +1,209 @@
+#ifndef DRAW_QUEUE_H
+#define DRAW_QUEUE_H
+
+#if !defined(__glew_h__) && !defined(__glad_h_)
+#include <glad/glad.h> // holds all OpenGL type declarations (Source.cpp pulls in GLEW instead)
+#endif
+
+#include "mesh_pool.h"
+#include "render_commands.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// One queued instanced draw. The handles are what gets bound, the key only decides the order,
+// so two handles that happen to share their low bits cost a state change, never a wrong draw.
+struct DrawItem
+{
+	std::uint64_t key;
+	GLuint program;
+	GLuint texture; // bound on unit 0, 0 when the program samples nothing
+	GLuint vao;
+	GLenum mode;
+	GLuint indexCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint instanceCount;
+	GLuint baseInstance;
+};
+
+// Collects a frame's draws in any order, sorts them by a packed 64-bit key and records them into a
+// CommandList with only the binds that change between neighbours. Opaque keys, most significant first:
+//   pass 4 | program 10 | texture 12 | vertex array 10 | depth 24 | unused 4
+// so draws group by program, then texture, then mesh, and each group runs front to back for early-z.
+// Transparent keys put the inverted depth right after the pass, back to front whatever the state.
+// Every run of draws sharing program, texture and vertex array becomes one glMultiDrawElementsIndirect,
+// so meshes suballocated from one MeshPool cost an indirect command each instead of a draw call each.
+class DrawQueue
+{
+public:
+	enum Pass { OPAQUE_PASS = 0, TRANSPARENT_PASS = 1, OVERLAY_PASS = 2 };
+
+	// program, texture and vertex array changes, the first draw counting all three
+	struct Stats
+	{
+		unsigned int draws = 0;
+		unsigned int indirect = 0; // indirect commands left after neighbours with contiguous instances were merged
+		unsigned int submitted = 0; // multi-draw calls, one per run of equal state
+		unsigned int changesUnsorted = 0; // had the draws been issued in the order they were added
+		unsigned int changesSorted = 0;
+	};
+
+	static const int DEPTH_BITS = 24;
+
+	// view-space distances outside [nearPlane, farPlane] are clamped into the first or last depth bucket
+	// ------------------------------------------------------------------------
+	void SetDepthRange(float nearPlane, float farPlane)
+	{
+		depthNear = nearPlane;
+		depthScale = farPlane > nearPlane ? 1.0f / (farPlane - nearPlane) : 0.0f;
+	}
+	// ------------------------------------------------------------------------
+	void Clear()
+	{
+		items.clear();
+	}
+	// ------------------------------------------------------------------------
+	void Add(Pass pass, GLuint program, GLuint texture, GLuint vao, float viewDepth, GLenum mode, const MeshAllocation& mesh, GLuint instanceCount, GLuint baseInstance)
+	{
+		float depth01 = std::min(1.0f, std::max(0.0f, (viewDepth - depthNear) * depthScale));
+		DrawItem item;
+		item.key = MakeKey(pass, program, texture, vao, (std::uint32_t)(depth01 * ((1 << DEPTH_BITS) - 1)));
+		item.program = program;
+		item.texture = texture;
+		item.vao = vao;
+		item.mode = mode;
+		item.indexCount = mesh.indexCount;
+		item.firstIndex = mesh.firstIndex;
+		item.baseVertex = mesh.baseVertex;
+		item.instanceCount = instanceCount;
+		item.baseInstance = baseInstance;
+		items.push_back(item);
+	}
+	// ------------------------------------------------------------------------
+	static std::uint64_t MakeKey(Pass pass, GLuint program, GLuint texture, GLuint vao, std::uint32_t depth)
+	{
+		std::uint64_t state = ((std::uint64_t)(program & 0x3ff) << 22) | ((std::uint64_t)(texture & 0xfff) << 10) | (vao & 0x3ff);
+		std::uint64_t quantized = depth & ((1u << DEPTH_BITS) - 1);
+		if (pass == TRANSPARENT_PASS)
+			return ((std::uint64_t)pass << 60) | ((((1u << DEPTH_BITS) - 1) - quantized) << 36) | (state << 4);
+		return ((std::uint64_t)pass << 60) | (state << 28) | (quantized << 4);
+	}
+	// sort by key with an LSD radix sort over 8-bit digits. Digits that are the same in every key
+	// (the pass, the unused bits, usually the high program bits) are detected from the histogram
+	// and skipped, so a frame costs a few linear passes instead of eight.
+	// ------------------------------------------------------------------------
+	void Sort()
+	{
+		size_t count = items.size();
+		order.resize(count);
+		scratch.resize(count);
+		for (size_t i = 0; i < count; i++)
+		{
+			order[i].key = items[i].key;
+			order[i].index = (std::uint32_t)i;
+		}
+		for (int shift = 0; shift < 64; shift += 8)
+		{
+			size_t histogram[256] = {};
+			for (size_t i = 0; i < count; i++)
+				histogram[(order[i].key >> shift) & 0xff]++;
+			if (count == 0 || histogram[(order[0].key >> shift) & 0xff] == count)
+				continue;
+			size_t offset = 0;
+			for (int digit = 0; digit < 256; digit++)
+			{
+				size_t digitCount = histogram[digit];
+				histogram[digit] = offset;
+				offset += digitCount;
+			}
+			for (size_t i = 0; i < count; i++)
+				scratch[histogram[(order[i].key >> shift) & 0xff]++] = order[i];
+			order.swap(scratch);
+		}
+	}
+	// sort, then record every draw into the list. Binds are emitted only when the value differs from
+	// the previous draw, neighbours drawing the same mesh over contiguous instance ranges are merged
+	// into one indirect command, and each run of equal state is one multi-draw call.
+	// ------------------------------------------------------------------------
+	Stats Flush(CommandList& list)
+	{
+		Stats stats;
+		stats.draws = (unsigned int)items.size();
+		stats.changesUnsorted = StateChanges(false);
+		Sort();
+		stats.changesSorted = StateChanges(true);
+		GLuint program = 0, texture = 0, vao = 0;
+		size_t i = 0;
+		while (i < order.size())
+		{
+			const DrawItem& first = items[order[i].index];
+			if (i == 0 || first.program != program)
+				list.UseProgram(program = first.program);
+			if (first.texture != 0 && first.texture != texture)
+				list.BindTexture(0, texture = first.texture);
+			if (i == 0 || first.vao != vao)
+				list.BindVertexArray(vao = first.vao);
+			GLuint firstCommand = (GLuint)list.indirect.size();
+			while (i < order.size() && SameState(first, items[order[i].index]))
+			{
+				const DrawItem& item = items[order[i++].index];
+				DrawElementsIndirectCommand command = { item.indexCount, item.instanceCount, item.firstIndex, item.baseVertex, item.baseInstance };
+				while (i < order.size() && Mergeable(item, items[order[i].index], command.instanceCount))
+					command.instanceCount += items[order[i++].index].instanceCount;
+				list.indirect.push_back(command);
+			}
+			list.MultiDrawIndirect(first.mode, firstCommand, (GLuint)list.indirect.size() - firstCommand);
+			stats.submitted++;
+		}
+		stats.indirect = (unsigned int)list.indirect.size();
+		return stats;
+	}
+	const std::vector<DrawItem>& Items() const
+	{
+		return items;
+	}
+
+private:
+	struct SortEntry
+	{
+		std::uint64_t key;
+		std::uint32_t index;
+	};
+
+	std::vector<DrawItem> items;
+	std::vector<SortEntry> order;
+	std::vector<SortEntry> scratch;
+	float depthNear = 0.1f;
+	float depthScale = 1.0f / (100.0f - 0.1f);
+
+	// the next draw can join the current multi-draw call: a texture of 0 matches any
+	static bool SameState(const DrawItem& first, const DrawItem& next)
+	{
+		return next.program == first.program && (next.texture == first.texture || next.texture == 0) && next.vao == first.vao && next.mode == first.mode;
+	}
+	// the next draw is the same mesh and its instances follow on from the current command's
+	static bool Mergeable(const DrawItem& first, const DrawItem& next, GLuint instanceCount)
+	{
+		return SameState(first, next) && next.indexCount == first.indexCount && next.firstIndex == first.firstIndex
+			&& next.baseVertex == first.baseVertex && next.baseInstance == first.baseInstance + instanceCount;
+	}
+	// binds needed to issue the items in sorted order (after Sort()) or in the order they were added
+	unsigned int StateChanges(bool sorted) const
+	{
+		unsigned int changes = 0;
+		GLuint program = 0, texture = 0, vao = 0;
+		for (size_t i = 0; i < items.size(); i++)
+		{
+			const DrawItem& item = items[sorted ? order[i].index : i];
+			changes += (i == 0 || item.program != program) + (item.texture != 0 && (i == 0 || item.texture != texture)) + (i == 0 || item.vao != vao);
+			program = item.program;
+			if (item.texture != 0)
+				texture = item.texture;
+			vao = item.vao;
+		}
+		return changes;
+	}
+};
+#endif
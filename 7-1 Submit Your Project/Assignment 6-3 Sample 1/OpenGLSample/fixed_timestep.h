@@ -0,0 +1,67 @@
+#ifndef FIXED_TIMESTEP_H
+#define FIXED_TIMESTEP_H
+
+#include <cmath>
+
+// Accumulator for a fixed-rate simulation driven by a variable-rate render loop. Each frame feeds
+// the elapsed wall time to Advance(), runs the returned number of ticks of exactly Step() seconds,
+// then renders with Alpha(), the fraction of a tick that has accumulated since the last one, to
+// blend the previous and current simulation states.
+class FixedTimestep
+{
+public:
+	explicit FixedTimestep(double stepSeconds, int maxTicksPerFrame = 8)
+		: step(stepSeconds), maxTicks(maxTicksPerFrame)
+	{
+	}
+	// returns the number of ticks to simulate this frame. After a long stall (a breakpoint, a window
+	// drag) at most maxTicksPerFrame are run and the rest of the backlog is dropped, so a slow frame
+	// cannot snowball into ever more ticks per frame.
+	// ------------------------------------------------------------------------
+	int Advance(double frameSeconds)
+	{
+		if (frameSeconds > 0.0)
+			accumulator += frameSeconds;
+		int ticks = 0;
+		while (accumulator >= step && ticks < maxTicks)
+		{
+			accumulator -= step;
+			ticks++;
+		}
+		if (ticks == maxTicks && accumulator >= step)
+		{
+			double backlog = accumulator - std::fmod(accumulator, step); // whole ticks left over, keep the fraction
+			droppedSeconds += backlog;
+			accumulator -= backlog;
+		}
+		totalTicks += ticks;
+		return ticks;
+	}
+	// interpolation weight between the previous and the current state, in [0, 1)
+	// ------------------------------------------------------------------------
+	float Alpha() const
+	{
+		return (float)(accumulator / step);
+	}
+	double Step() const
+	{
+		return step;
+	}
+	unsigned long long TotalTicks() const
+	{
+		return totalTicks;
+	}
+	// simulated time thrown away by the stall guard in Advance()
+	double DroppedSeconds() const
+	{
+		return droppedSeconds;
+	}
+
+private:
+	double step;
+	int maxTicks;
+	double accumulator = 0.0;
+	double droppedSeconds = 0.0;
+	unsigned long long totalTicks = 0;
+};
+#endif
@@ -0,0 +1,132 @@
+#ifndef FRAME_BENCHMARK_H
+#define FRAME_BENCHMARK_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Frame time recorder for fixed-length benchmark runs. Every frame is cut into named stages by calling
+// Stage() after each one; Report() prints p50/p95/p99 of the whole frame and of every stage. Stage
+// names are matched by pointer, so pass string literals. When not started every call is a no-op.
+class FrameBenchmark
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	// reserve room for the whole run so recording never allocates mid-benchmark
+	// ------------------------------------------------------------------------
+	void Start(size_t frameCount)
+	{
+		active = true;
+		frameMs.clear();
+		frameMs.reserve(frameCount);
+		for (size_t i = 0; i < stages.size(); i++)
+			stages[i].ms.clear();
+		expectedFrames = frameCount;
+	}
+	bool Active() const
+	{
+		return active;
+	}
+	// ------------------------------------------------------------------------
+	void BeginFrame()
+	{
+		if (!active)
+			return;
+		frameStart = Clock::now();
+		stageStart = frameStart;
+	}
+	// closes the stage that began at the previous Stage() or BeginFrame() call
+	// ------------------------------------------------------------------------
+	void Stage(const char* name)
+	{
+		if (!active)
+			return;
+		Clock::time_point now = Clock::now();
+		Find(name).ms.push_back(Milliseconds(stageStart, now));
+		stageStart = now;
+	}
+	// ------------------------------------------------------------------------
+	void EndFrame()
+	{
+		if (!active)
+			return;
+		frameMs.push_back(Milliseconds(frameStart, Clock::now()));
+	}
+	size_t Frames() const
+	{
+		return frameMs.size();
+	}
+	// print the percentile table, the first skipFrames frames are left out as warm-up
+	// ------------------------------------------------------------------------
+	void Report(std::ostream& out, size_t skipFrames = 0) const
+	{
+		out << std::fixed << std::setprecision(3);
+		out << "INFO: " << std::max(frameMs.size(), skipFrames) - skipFrames << " frames measured (" << skipFrames << " warm-up), ms:" << std::endl;
+		out << "INFO: " << std::setw(10) << "stage" << std::setw(10) << "mean" << std::setw(10) << "p50"
+			<< std::setw(10) << "p95" << std::setw(10) << "p99" << std::setw(10) << "max" << std::endl;
+		for (size_t i = 0; i < stages.size(); i++)
+			ReportRow(out, stages[i].name, stages[i].ms, skipFrames);
+		ReportRow(out, "frame", frameMs, skipFrames);
+		out.unsetf(std::ios::fixed);
+		out << std::setprecision(6);
+	}
+	// nearest-rank percentile, p in [0, 100]
+	// ------------------------------------------------------------------------
+	static double Percentile(std::vector<double> values, double p)
+	{
+		if (values.empty())
+			return 0.0;
+		size_t rank = (size_t)std::min<double>((double)values.size() - 1.0, std::max(0.0, p / 100.0 * values.size() - 0.5));
+		std::nth_element(values.begin(), values.begin() + rank, values.end());
+		return values[rank];
+	}
+
+private:
+	struct StageTimes
+	{
+		const char* name;
+		std::vector<double> ms;
+	};
+
+	bool active = false;
+	size_t expectedFrames = 0;
+	Clock::time_point frameStart, stageStart;
+	std::vector<double> frameMs;
+	std::vector<StageTimes> stages; // in first-seen order, which is pipeline order
+
+	static double Milliseconds(Clock::time_point from, Clock::time_point to)
+	{
+		return std::chrono::duration<double, std::milli>(to - from).count();
+	}
+	StageTimes& Find(const char* name)
+	{
+		for (size_t i = 0; i < stages.size(); i++)
+			if (stages[i].name == name)
+				return stages[i];
+		StageTimes stage;
+		stage.name = name;
+		stage.ms.reserve(expectedFrames);
+		stages.push_back(stage);
+		return stages.back();
+	}
+	static void ReportRow(std::ostream& out, const char* name, const std::vector<double>& all, size_t skipFrames)
+	{
+		if (all.size() <= skipFrames)
+			return;
+		std::vector<double> values(all.begin() + skipFrames, all.end());
+		double sum = 0.0, largest = 0.0;
+		for (size_t i = 0; i < values.size(); i++)
+		{
+			sum += values[i];
+			largest = std::max(largest, values[i]);
+		}
+		out << "INFO: " << std::setw(10) << name << std::setw(10) << sum / values.size() << std::setw(10) << Percentile(values, 50.0)
+			<< std::setw(10) << Percentile(values, 95.0) << std::setw(10) << Percentile(values, 99.0) << std::setw(10) << largest << std::endl;
+	}
+};
+#endif
@@ -0,0 +1,78 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#if !defined(__glew_h__) && !defined(__glad_h_)
+#include <glad/glad.h> // holds all OpenGL type declarations (Source.cpp pulls in GLEW instead)
+#endif
+
+#include <glm/glm.hpp>
+
+#include "stream_buffer.h"
+
+#include <cstring>
+
+// Binding point of the per-frame uniform block. Shaders declare it as
+//   layout(std140, binding = 0) uniform FrameBlock { ... };
+const GLuint FRAME_UNIFORMS_BINDING = 0;
+
+// CPU mirror of the FrameBlock uniform block (std140 layout). Every vec3 in the block is padded
+// to 16 bytes by std140, so the matching members here are vec4 and only xyz is read.
+struct FrameUniforms
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 viewPosition;
+	glm::vec4 keyLightColor;
+	glm::vec4 keyLightPosition;
+	glm::vec4 fillLightColor;
+	glm::vec4 fillLightPosition;
+};
+
+// Owns the uniform buffer behind FrameBlock. It is uploaded once per frame and stays bound to
+// FRAME_UNIFORMS_BINDING, so every program reads camera and light state from the same buffer.
+class FrameUniformBuffer
+{
+public:
+	GLuint UBO = 0;
+
+	// create the buffer and attach it to the fixed binding point
+	// ------------------------------------------------------------------------
+	void Create()
+	{
+		glGenBuffers(1, &UBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, UBO);
+	}
+	// replace the whole block, called once per frame before the first draw
+	// ------------------------------------------------------------------------
+	void Upload(const FrameUniforms& frame)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+	// write the block into the stream buffer's current region and bind that range instead, so the
+	// upload is a memcpy into mapped memory. Falls back to the buffer's own storage when the region is full.
+	// ------------------------------------------------------------------------
+	void Upload(const FrameUniforms& frame, StreamBuffer& stream)
+	{
+		StreamBuffer::Allocation allocation = stream.Allocate(sizeof(FrameUniforms), stream.UniformAlignment());
+		if (!allocation.data)
+		{
+			glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, UBO);
+			Upload(frame);
+			return;
+		}
+		std::memcpy(allocation.data, &frame, sizeof(FrameUniforms));
+		glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, stream.buffer, allocation.offset, sizeof(FrameUniforms));
+	}
+	// ------------------------------------------------------------------------
+	void Destroy()
+	{
+		glDeleteBuffers(1, &UBO);
+		UBO = 0;
+	}
+};
+#endif
@@ -0,0 +1,207 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#if !defined(__glew_h__) && !defined(__glad_h_)
+#include <glad/glad.h> // holds all OpenGL type declarations (Source.cpp pulls in GLEW instead)
+#endif
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <vector>
+
+// Thin redundant-state filter in front of the GL calls the render loop makes every frame.
+// It shadows the bound program, vertex array, textures, capabilities, clear color and uniform
+// values, and drops any call that would not change what the driver already has.
+class GLStateCache
+{
+public:
+	// calls forwarded to the driver and calls dropped as no-ops since the last TakeStats()
+	struct Stats
+	{
+		unsigned int issued = 0;
+		unsigned int skippedPrograms = 0;
+		unsigned int skippedVertexArrays = 0;
+		unsigned int skippedTextures = 0;
+		unsigned int skippedState = 0;
+		unsigned int skippedUniforms = 0;
+
+		unsigned int Skipped() const
+		{
+			return skippedPrograms + skippedVertexArrays + skippedTextures + skippedState + skippedUniforms;
+		}
+	};
+
+	GLStateCache()
+	{
+		Invalidate();
+	}
+	// forget everything, call after GL state was changed behind the cache's back
+	// ------------------------------------------------------------------------
+	void Invalidate()
+	{
+		program = UNKNOWN;
+		vertexArray = UNKNOWN;
+		activeUnit = UNKNOWN;
+		for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+			textures[i] = UNKNOWN;
+		capabilities.clear();
+		clearColorKnown = false;
+		uniformValues.clear();
+	}
+	// forget only the texture bindings, call after code outside the cache bound textures
+	// ------------------------------------------------------------------------
+	void InvalidateTextures()
+	{
+		activeUnit = UNKNOWN;
+		for (unsigned int i = 0; i < MAX_TEXTURE_UNITS; i++)
+			textures[i] = UNKNOWN;
+	}
+	// ------------------------------------------------------------------------
+	void UseProgram(GLuint id)
+	{
+		if (program == id)
+		{
+			stats.skippedPrograms++;
+			return;
+		}
+		program = id;
+		glUseProgram(id);
+		stats.issued++;
+	}
+	// ------------------------------------------------------------------------
+	void BindVertexArray(GLuint id)
+	{
+		if (vertexArray == id)
+		{
+			stats.skippedVertexArrays++;
+			return;
+		}
+		vertexArray = id;
+		glBindVertexArray(id);
+		stats.issued++;
+	}
+	// binds a 2D texture to the given unit, switching the active unit only when needed
+	// ------------------------------------------------------------------------
+	void BindTexture(GLuint unit, GLuint id)
+	{
+		if (unit < MAX_TEXTURE_UNITS && textures[unit] == id)
+		{
+			stats.skippedTextures++;
+			return;
+		}
+		if (activeUnit != unit)
+		{
+			activeUnit = unit;
+			glActiveTexture(GL_TEXTURE0 + unit);
+			stats.issued++;
+		}
+		if (unit < MAX_TEXTURE_UNITS)
+			textures[unit] = id;
+		glBindTexture(GL_TEXTURE_2D, id);
+		stats.issued++;
+	}
+	// ------------------------------------------------------------------------
+	void Enable(GLenum capability)
+	{
+		SetCapability(capability, true);
+	}
+	void Disable(GLenum capability)
+	{
+		SetCapability(capability, false);
+	}
+	// ------------------------------------------------------------------------
+	void ClearColor(GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+	{
+		if (clearColorKnown && clearColor[0] == r && clearColor[1] == g && clearColor[2] == b && clearColor[3] == a)
+		{
+			stats.skippedState++;
+			return;
+		}
+		clearColorKnown = true;
+		clearColor[0] = r;
+		clearColor[1] = g;
+		clearColor[2] = b;
+		clearColor[3] = a;
+		glClearColor(r, g, b, a);
+		stats.issued++;
+	}
+	// uniform uploads for the currently bound program, dropped when the value matches the last upload
+	// ------------------------------------------------------------------------
+	void Uniform1i(GLint location, GLint value)
+	{
+		if (UniformChanged(location, &value, sizeof(value)))
+			glUniform1i(location, value);
+	}
+	void Uniform2fv(GLint location, const GLfloat* value)
+	{
+		if (UniformChanged(location, value, 2 * sizeof(GLfloat)))
+			glUniform2fv(location, 1, value);
+	}
+	void Uniform3fv(GLint location, const GLfloat* value)
+	{
+		if (UniformChanged(location, value, 3 * sizeof(GLfloat)))
+			glUniform3fv(location, 1, value);
+	}
+	void UniformMatrix4fv(GLint location, const GLfloat* value)
+	{
+		if (UniformChanged(location, value, 16 * sizeof(GLfloat)))
+			glUniformMatrix4fv(location, 1, GL_FALSE, value);
+	}
+	// returns the counters collected since the previous call and resets them
+	// ------------------------------------------------------------------------
+	Stats TakeStats()
+	{
+		Stats taken = stats;
+		stats = Stats();
+		return taken;
+	}
+
+private:
+	static const GLuint UNKNOWN = 0xFFFFFFFFu;
+	static const unsigned int MAX_TEXTURE_UNITS = 16;
+
+	GLuint program;
+	GLuint vertexArray;
+	GLuint activeUnit;
+	GLuint textures[MAX_TEXTURE_UNITS];
+	std::map<GLenum, bool> capabilities;
+	bool clearColorKnown;
+	GLfloat clearColor[4];
+	std::map<std::uint64_t, std::vector<unsigned char>> uniformValues; // keyed by program << 32 | location
+	Stats stats;
+
+	void SetCapability(GLenum capability, bool enabled)
+	{
+		std::map<GLenum, bool>::iterator it = capabilities.find(capability);
+		if (it != capabilities.end() && it->second == enabled)
+		{
+			stats.skippedState++;
+			return;
+		}
+		capabilities[capability] = enabled;
+		if (enabled)
+			glEnable(capability);
+		else
+			glDisable(capability);
+		stats.issued++;
+	}
+	bool UniformChanged(GLint location, const void* value, size_t size)
+	{
+		if (location < 0 || program == UNKNOWN)
+		{
+			stats.issued++;
+			return true; // nothing to compare against, let the driver decide
+		}
+		std::vector<unsigned char>& last = uniformValues[((std::uint64_t)program << 32) | (std::uint32_t)location];
+		if (last.size() == size && std::memcmp(&last[0], value, size) == 0)
+		{
+			stats.skippedUniforms++;
+			return false;
+		}
+		last.assign((const unsigned char*)value, (const unsigned char*)value + size);
+		stats.issued++;
+		return true;
+	}
+};
+#endif
@@ -0,0 +1,231 @@
+#ifndef GPU_PROFILER_H
+#define GPU_PROFILER_H
+
+#if !defined(__glew_h__) && !defined(__glad_h_)
+#include <glad/glad.h> // holds all OpenGL type declarations (Source.cpp pulls in GLEW instead)
+#endif
+
+#include "gl_state.h"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+// Per-pass GPU and CPU timing for the render loop. Each pass is bracketed by Begin()/End(), which
+// wrap a GL_TIME_ELAPSED query and a CPU clock. Queries live in a ring of QUERY_LATENCY frames and
+// are only read once GL_QUERY_RESULT_AVAILABLE says so, so reading back never stalls the pipeline;
+// a frame whose results are still outstanding when its slot comes round again is dropped.
+// Time-elapsed queries cannot nest, so passes must follow one another.
+class GPUProfiler
+{
+public:
+	static const int QUERY_LATENCY = 4; // frames of queries in flight
+	static const int MAX_PASSES = 16; // per frame
+	static const int HISTORY = 128; // frames kept per pass
+
+	struct Pass
+	{
+		const char* name;
+		float gpuMs[HISTORY];
+		float cpuMs[HISTORY];
+		float gpuAverage;
+		float cpuAverage;
+	};
+
+	// ------------------------------------------------------------------------
+	void Create()
+	{
+		for (int i = 0; i < QUERY_LATENCY; i++)
+		{
+			glGenQueries(MAX_PASSES, frames[i].queries);
+			frames[i].count = 0;
+			frames[i].pending = false;
+		}
+		current = 0;
+		resolved = 0;
+		dropped = 0;
+	}
+	// ------------------------------------------------------------------------
+	void Destroy()
+	{
+		for (int i = 0; i < QUERY_LATENCY; i++)
+			glDeleteQueries(MAX_PASSES, frames[i].queries);
+	}
+	// collect every finished frame and claim the next query slot
+	// ------------------------------------------------------------------------
+	void BeginFrame()
+	{
+		for (int i = 0; i < QUERY_LATENCY; i++) // the slot about to be reused is the oldest
+		{
+			FrameQueries& frame = frames[(current + i) % QUERY_LATENCY];
+			if (frame.pending && !Collect(frame))
+				break; // queries complete in order, nothing newer can be ready
+		}
+		FrameQueries& frame = frames[current];
+		if (frame.pending)
+		{
+			dropped++; // still unfinished after QUERY_LATENCY frames, reuse the slot anyway
+			frame.pending = false;
+		}
+		frame.count = 0;
+	}
+	// ------------------------------------------------------------------------
+	void Begin(const char* name)
+	{
+		FrameQueries& frame = frames[current];
+		if (frame.count == MAX_PASSES)
+			return;
+		frame.passes[frame.count] = Find(name);
+		frame.cpuStart = Clock::now();
+		glBeginQuery(GL_TIME_ELAPSED, frame.queries[frame.count]);
+	}
+	// ------------------------------------------------------------------------
+	void End()
+	{
+		FrameQueries& frame = frames[current];
+		if (frame.count == MAX_PASSES)
+			return;
+		glEndQuery(GL_TIME_ELAPSED);
+		frame.cpuMs[frame.count] = (float)std::chrono::duration<double, std::milli>(Clock::now() - frame.cpuStart).count();
+		frame.count++;
+	}
+	// ------------------------------------------------------------------------
+	void EndFrame()
+	{
+		frames[current].pending = frames[current].count > 0;
+		current = (current + 1) % QUERY_LATENCY;
+	}
+	// passes in first-seen order with their rolling history, column (Resolved() - 1) % HISTORY is the newest
+	// ------------------------------------------------------------------------
+	const std::vector<Pass>& Passes() const
+	{
+		return passes;
+	}
+	unsigned int Resolved() const
+	{
+		return resolved;
+	}
+	unsigned int Dropped() const
+	{
+		return dropped;
+	}
+	// draws the overlay in the top-left corner with scissored clears, so no shader or geometry is needed.
+	// One row per pass: GPU average as a thick bar, CPU average as a thin one, full width = budgetMs.
+	// Below it the stacked GPU time of the last HISTORY frames, with a line at budgetMs.
+	// ------------------------------------------------------------------------
+	void DrawHUD(GLStateCache& state, int height, float budgetMs = 1000.0f / 60.0f)
+	{
+		const int margin = 8, barWidth = 256, rowHeight = 12, graphHeight = 96, columnWidth = 2;
+		const int panelWidth = std::max(barWidth, HISTORY * columnWidth) + 2 * margin;
+		const int panelHeight = (int)passes.size() * rowHeight + graphHeight + 3 * margin;
+		const int left = margin, top = height - margin;
+		state.Enable(GL_SCISSOR_TEST);
+		Rect(state, left, top - panelHeight, panelWidth, panelHeight, 0.05f, 0.05f, 0.05f);
+		for (size_t i = 0; i < passes.size(); i++)
+		{
+			const float* color = Color(i);
+			int y = top - margin - (int)(i + 1) * rowHeight;
+			Rect(state, left + margin, y + 4, Scale(passes[i].gpuAverage, budgetMs, barWidth), rowHeight - 5, color[0], color[1], color[2]);
+			Rect(state, left + margin, y + 1, Scale(passes[i].cpuAverage, budgetMs, barWidth), 2, color[0] * 0.5f, color[1] * 0.5f, color[2] * 0.5f);
+		}
+		int graphBottom = top - panelHeight + margin;
+		int frameCount = (int)std::min<unsigned int>(resolved, HISTORY);
+		for (int f = 0; f < frameCount; f++)
+		{
+			int column = (int)((resolved - frameCount + f) % HISTORY);
+			int y = graphBottom;
+			for (size_t i = 0; i < passes.size(); i++)
+			{
+				int h = Scale(passes[i].gpuMs[column], budgetMs, graphHeight);
+				const float* color = Color(i);
+				Rect(state, left + margin + f * columnWidth, y, columnWidth, h, color[0], color[1], color[2]);
+				y += h;
+			}
+		}
+		Rect(state, left + margin, graphBottom + graphHeight, HISTORY * columnWidth, 1, 1.0f, 1.0f, 1.0f);
+		state.Disable(GL_SCISSOR_TEST);
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct FrameQueries
+	{
+		GLuint queries[MAX_PASSES];
+		int passes[MAX_PASSES];
+		float cpuMs[MAX_PASSES];
+		int count;
+		bool pending;
+		Clock::time_point cpuStart;
+	};
+
+	FrameQueries frames[QUERY_LATENCY];
+	int current = 0;
+	unsigned int resolved = 0;
+	unsigned int dropped = 0;
+	std::vector<Pass> passes;
+
+	int Find(const char* name)
+	{
+		for (size_t i = 0; i < passes.size(); i++)
+			if (passes[i].name == name)
+				return (int)i;
+		Pass pass = {};
+		pass.name = name;
+		passes.push_back(pass);
+		return (int)passes.size() - 1;
+	}
+	// reads a frame's results if all of them are in, returns false without waiting otherwise
+	bool Collect(FrameQueries& frame)
+	{
+		GLint available = 0;
+		glGetQueryObjectiv(frame.queries[frame.count - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return false;
+		int column = (int)(resolved % HISTORY);
+		for (size_t i = 0; i < passes.size(); i++)
+			passes[i].gpuMs[column] = passes[i].cpuMs[column] = 0.0f;
+		for (int i = 0; i < frame.count; i++)
+		{
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(frame.queries[i], GL_QUERY_RESULT, &nanoseconds);
+			passes[frame.passes[i]].gpuMs[column] += nanoseconds / 1.0e6f;
+			passes[frame.passes[i]].cpuMs[column] += frame.cpuMs[i];
+		}
+		frame.pending = false;
+		resolved++;
+		int frameCount = (int)std::min<unsigned int>(resolved, HISTORY);
+		for (size_t i = 0; i < passes.size(); i++)
+		{
+			float gpu = 0.0f, cpu = 0.0f;
+			for (int f = 0; f < frameCount; f++)
+			{
+				gpu += passes[i].gpuMs[f];
+				cpu += passes[i].cpuMs[f];
+			}
+			passes[i].gpuAverage = gpu / frameCount;
+			passes[i].cpuAverage = cpu / frameCount;
+		}
+		return true;
+	}
+	static int Scale(float ms, float budgetMs, int pixels)
+	{
+		return std::min(pixels, (int)(ms / budgetMs * pixels + 0.5f));
+	}
+	static const float* Color(size_t pass)
+	{
+		static const float palette[8][3] = {
+			{ 0.90f, 0.30f, 0.25f }, { 0.30f, 0.75f, 0.35f }, { 0.30f, 0.50f, 0.95f }, { 0.95f, 0.80f, 0.25f },
+			{ 0.75f, 0.35f, 0.90f }, { 0.25f, 0.85f, 0.85f }, { 0.95f, 0.55f, 0.20f }, { 0.70f, 0.70f, 0.70f } };
+		return palette[pass % 8];
+	}
+	static void Rect(GLStateCache& state, int x, int y, int w, int h, float r, float g, float b)
+	{
+		if (w <= 0 || h <= 0)
+			return;
+		glScissor(x, y, w, h);
+		state.ClearColor(r, g, b, 1.0f);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
+};
+#endif
@@ -0,0 +1,111 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+// An OpenGL core context with no window and no display server, for headless runs on build machines.
+// On Linux it is an EGL context on Mesa's surfaceless platform: nothing is presented, so it needs no
+// X11 or Wayland connection and runs on llvmpipe (LIBGL_ALWAYS_SOFTWARE=1) on a machine without a GPU.
+// Rendering goes to a framebuffer object, the context is made current with no surface at all.
+// Elsewhere Available() is false and the caller falls back to a hidden window.
+#if defined(__linux__)
+#define HEADLESS_EGL
+#ifndef EGL_NO_X11
+#define EGL_NO_X11 // keep Xlib's macros (None, Status, ...) out of every translation unit
+#endif
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#include <cstring>
+
+class HeadlessContext
+{
+public:
+	static bool Available()
+	{
+#ifdef HEADLESS_EGL
+		return true;
+#else
+		return false;
+#endif
+	}
+#ifdef HEADLESS_EGL
+	// create a core profile context of the given version and make it current on the calling thread.
+	// Tries the surfaceless platform first and the default display after it.
+	// ------------------------------------------------------------------------
+	bool Create(int major, int minor)
+	{
+		const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay && clientExtensions && std::strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+			display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+		{
+			display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+			if (display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL))
+			{
+				display = EGL_NO_DISPLAY;
+				return false;
+			}
+		}
+		const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+		if (!extensions || !std::strstr(extensions, "EGL_KHR_surfaceless_context") || !eglBindAPI(EGL_OPENGL_API))
+		{
+			Destroy();
+			return false;
+		}
+		// no surface is ever created, so any desktop GL config will do
+		const EGLint configAttributes[] = { EGL_SURFACE_TYPE, 0, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+		EGLConfig config;
+		EGLint configCount = 0;
+		if (!eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0)
+		{
+			Destroy();
+			return false;
+		}
+		const EGLint contextAttributes[] = { EGL_CONTEXT_MAJOR_VERSION, major, EGL_CONTEXT_MINOR_VERSION, minor,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE };
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+		if (context == EGL_NO_CONTEXT || !MakeCurrent(true))
+		{
+			Destroy();
+			return false;
+		}
+		return true;
+	}
+	// attach the context to the calling thread, or release it from the thread when current is false
+	// ------------------------------------------------------------------------
+	bool MakeCurrent(bool current)
+	{
+		return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, current ? context : EGL_NO_CONTEXT) == EGL_TRUE;
+	}
+	// ------------------------------------------------------------------------
+	void Destroy()
+	{
+		if (display == EGL_NO_DISPLAY)
+			return;
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		if (context != EGL_NO_CONTEXT)
+			eglDestroyContext(display, context);
+		eglTerminate(display);
+		context = EGL_NO_CONTEXT;
+		display = EGL_NO_DISPLAY;
+	}
+
+private:
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+#else
+	bool Create(int, int)
+	{
+		return false;
+	}
+	bool MakeCurrent(bool)
+	{
+		return false;
+	}
+	void Destroy()
+	{
+	}
+#endif
+};
+#endif
@@ -0,0 +1,139 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#if !defined(__glew_h__) && !defined(__glad_h_)
+#include <glad/glad.h> // holds all OpenGL type declarations (Source.cpp pulls in GLEW instead)
+#endif
+
+#include <glm/glm.hpp>
+
+#include "normal_matrix.h"
+#include "stream_buffer.h"
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// Per-instance vertex data, read with a divisor of 1
+struct InstanceData
+{
+	glm::mat4 Model;
+	glm::vec4 Color;
+	glm::mat3 NormalMatrix; // filled in by Upload(), not by the caller
+};
+
+// Attribute locations used by instanced shaders, after the per-vertex position/normal/uv at 0-2.
+// A mat4 attribute takes four consecutive locations, one per column.
+const GLuint INSTANCE_MODEL_LOCATION = 3;
+const GLuint INSTANCE_COLOR_LOCATION = 7;
+const GLuint INSTANCE_NORMAL_MATRIX_LOCATION = 8; // mat3, locations 8-10
+
+// One instance VBO for the whole scene. Every object adds its instances each frame; a group of
+// copies of the same mesh is then drawn with one glDraw*InstancedBaseInstance call whose base
+// instance points at the group's first entry, so draw calls no longer grow with object count.
+// Created on a StreamBuffer, the attributes read the stream buffer instead and each frame's
+// instances land wherever its region has room; draws then add the returned first instance.
+class InstanceBuffer
+{
+public:
+	GLuint VBO = 0;
+	std::vector<InstanceData> instances;
+
+	// create the buffer and attach its attributes to a vertex array that already holds the mesh attributes
+	// ------------------------------------------------------------------------
+	void Create(GLuint vao)
+	{
+		glGenBuffers(1, &VBO);
+		Attach(vao);
+	}
+	// read instances from a stream buffer, which the instance buffer does not own
+	// ------------------------------------------------------------------------
+	void Create(GLuint vao, const StreamBuffer& stream)
+	{
+		VBO = stream.buffer;
+		streamed = true;
+		Attach(vao);
+	}
+	// point another vertex array at the same instance stream
+	// ------------------------------------------------------------------------
+	void Attach(GLuint vao)
+	{
+		glBindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		for (GLuint column = 0; column < 4; column++)
+		{
+			glEnableVertexAttribArray(INSTANCE_MODEL_LOCATION + column);
+			glVertexAttribPointer(INSTANCE_MODEL_LOCATION + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, Model) + sizeof(glm::vec4) * column));
+			glVertexAttribDivisor(INSTANCE_MODEL_LOCATION + column, 1);
+		}
+		glEnableVertexAttribArray(INSTANCE_COLOR_LOCATION);
+		glVertexAttribPointer(INSTANCE_COLOR_LOCATION, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)offsetof(InstanceData, Color));
+		glVertexAttribDivisor(INSTANCE_COLOR_LOCATION, 1);
+		for (GLuint column = 0; column < 3; column++)
+		{
+			glEnableVertexAttribArray(INSTANCE_NORMAL_MATRIX_LOCATION + column);
+			glVertexAttribPointer(INSTANCE_NORMAL_MATRIX_LOCATION + column, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(offsetof(InstanceData, NormalMatrix) + sizeof(glm::vec3) * column));
+			glVertexAttribDivisor(INSTANCE_NORMAL_MATRIX_LOCATION + column, 1);
+		}
+		glBindVertexArray(0);
+	}
+	// start a new frame of instances
+	// ------------------------------------------------------------------------
+	void Clear()
+	{
+		instances.clear();
+	}
+	// append one instance and return its index, which is the base instance of its group
+	// ------------------------------------------------------------------------
+	GLuint Add(const glm::mat4& model, const glm::vec4& color)
+	{
+		InstanceData instance;
+		instance.Model = model;
+		instance.Color = color;
+		instances.push_back(instance);
+		return (GLuint)instances.size() - 1;
+	}
+	// send this frame's instances to the GPU, orphaning last frame's storage so the upload never waits on it.
+	// Normal matrices for the whole frame are derived here in one batch.
+	// ------------------------------------------------------------------------
+	void Upload()
+	{
+		if (!instances.empty())
+			ComputeNormalMatrices(&instances[0].Model, sizeof(InstanceData), &instances[0].NormalMatrix, sizeof(InstanceData), instances.size());
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		if (instances.size() > capacity)
+			capacity = instances.capacity();
+		glBufferData(GL_ARRAY_BUFFER, capacity * sizeof(InstanceData), NULL, GL_STREAM_DRAW);
+		if (!instances.empty())
+			glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(InstanceData), &instances[0]);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	// copy this frame's instances into the stream buffer, aligned to whole instances so that
+	// firstInstance = offset / sizeof(InstanceData) is what every draw adds to its base instance.
+	// Returns false when the stream's region is full.
+	// ------------------------------------------------------------------------
+	bool Upload(StreamBuffer& stream, GLuint& firstInstance)
+	{
+		if (!instances.empty())
+			ComputeNormalMatrices(&instances[0].Model, sizeof(InstanceData), &instances[0].NormalMatrix, sizeof(InstanceData), instances.size());
+		StreamBuffer::Allocation allocation = stream.Allocate(instances.size() * sizeof(InstanceData), sizeof(InstanceData));
+		if (!allocation.data)
+			return false;
+		if (!instances.empty()) // computed above in cached memory, the mapping is write-combined and slow to read back
+			std::memcpy(allocation.data, &instances[0], instances.size() * sizeof(InstanceData));
+		firstInstance = (GLuint)(allocation.offset / sizeof(InstanceData));
+		return true;
+	}
+	// ------------------------------------------------------------------------
+	void Destroy()
+	{
+		if (!streamed)
+			glDeleteBuffers(1, &VBO);
+		VBO = 0;
+	}
+
+private:
+	size_t capacity = 0;
+	bool streamed = false;
+};
+#endif
@@ -0,0 +1,237 @@
+#ifndef LIGHT_CLUSTERS_H
+#define LIGHT_CLUSTERS_H
+
+#if !defined(__glew_h__) && !defined(__glad_h_)
+#include <glad/glad.h> // holds all OpenGL type declarations (Source.cpp pulls in GLEW instead)
+#endif
+
+#include <glm/glm.hpp>
+
+#include "stream_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+// Clustered forward lighting (Olsson, Billeter and Assarsson, "Clustered Deferred and Forward Shading",
+// 2012). The view frustum is cut into froxels: screen tiles, each split into depth slices that grow
+// exponentially with distance. Every light is binned on the CPU into the froxels its sphere of influence
+// touches, and a fragment shades with only the lights listed for its own froxel, so its cost follows the
+// lights around it rather than the lights in the scene. Shaders declare the three buffers as
+//   struct ClusterLight { vec4 positionRange; vec4 color; vec4 shading; };
+//   layout(std430, binding = 1) readonly buffer LightBlock { ClusterLight lights[]; };
+//   layout(std430, binding = 2) readonly buffer ClusterGrid { uvec4 clusterSize; vec4 clusterDepth; vec4 clusterTile; uvec2 clusterLights[]; };
+//   layout(std430, binding = 3) readonly buffer LightIndexBlock { uint lightIndices[]; };
+// and find their froxel with
+//   uvec3 cell = min(uvec3(uvec2(gl_FragCoord.xy / clusterTile.xy), uint(max(log(viewDepth / clusterDepth.x) * clusterDepth.z, 0.0))), clusterSize.xyz - 1u);
+//   uvec2 range = clusterLights[(cell.z * clusterSize.y + cell.y) * clusterSize.x + cell.x]; // first index, count
+const GLuint LIGHT_BUFFER_BINDING = 1;
+const GLuint CLUSTER_GRID_BINDING = 2;
+const GLuint LIGHT_INDEX_BINDING = 3;
+
+// One light as the shaders read it (std430). A range of 0 means no falloff: the light reaches every
+// froxel, which is how the scene's key and fill lights keep their unattenuated look.
+struct ClusterLight
+{
+	glm::vec4 positionRange; // world position, radius of influence
+	glm::vec4 color; // rgb, w unused
+	glm::vec4 shading; // specular strength, highlight size, diffuse floor, ambient strength
+};
+
+// Head of the ClusterGrid buffer, followed by one (first index, count) pair per froxel
+struct ClusterGridHeader
+{
+	glm::uvec4 size; // tiles across, tiles down, depth slices, light count
+	glm::vec4 depth; // near plane, far plane, slices / log(far / near)
+	glm::vec4 tile; // tile width and height in pixels
+};
+
+// The lights of one frame and their froxel lists. Filling and building touch no GL, so a frame's lights
+// are binned by whichever thread records it; Upload() writes the three buffers into the stream buffer
+// on the thread that owns the context. Clear() keeps every array's capacity. A froxel keeps at most
+// MAX_LIGHTS_PER_CLUSTER lights, the first ones added, so the key and fill lights are never dropped and
+// UploadBytes() bounds what a frame writes to the stream buffer however many lights there are.
+class LightClusters
+{
+public:
+	static const unsigned int TILES_X = 16;
+	static const unsigned int TILES_Y = 9;
+	static const unsigned int SLICES = 24;
+	static const unsigned int CLUSTERS = TILES_X * TILES_Y * SLICES;
+	static const unsigned int MAX_LIGHTS_PER_CLUSTER = 64;
+
+	ClusterGridHeader header;
+	std::vector<ClusterLight> lights;
+	std::vector<glm::uvec2> clusters; // first entry in indices and light count, per froxel
+	std::vector<GLuint> indices; // every froxel's light list, back to back
+	unsigned int dropped = 0; // lights left out of full froxels by the last Build()
+
+	// ------------------------------------------------------------------------
+	void Clear()
+	{
+		lights.clear();
+		clusters.clear();
+		indices.clear();
+	}
+	void Add(const glm::vec3& position, float range, const glm::vec3& color, float specular, float highlightSize, float diffuseFloor, float ambient)
+	{
+		ClusterLight light;
+		light.positionRange = glm::vec4(position, range);
+		light.color = glm::vec4(color, 1.0f);
+		light.shading = glm::vec4(specular, highlightSize, diffuseFloor, ambient);
+		lights.push_back(light);
+	}
+	// bin every light into the froxels of a width x height view whose depth runs from nearPlane to farPlane.
+	// Works for perspective and orthographic projections: froxel depth is view-space distance either way.
+	// ------------------------------------------------------------------------
+	void Build(const glm::mat4& view, const glm::mat4& projection, float nearPlane, float farPlane, int width, int height)
+	{
+		header.size = glm::uvec4(TILES_X, TILES_Y, SLICES, (unsigned int)lights.size());
+		header.depth = glm::vec4(nearPlane, farPlane, SLICES / std::log(farPlane / nearPlane), 0.0f);
+		header.tile = glm::vec4((float)std::max(width, 1) / TILES_X, (float)std::max(height, 1) / TILES_Y, 0.0f, 0.0f);
+		// first pass: the box of froxels each light overlaps, and how many lights land in each froxel
+		cells.resize(lights.size());
+		clusters.assign(CLUSTERS, glm::uvec2(0));
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			Cells& cell = cells[i];
+			cell.touched = CellRange(lights[i], view, projection, cell.low, cell.high);
+			if (!cell.touched)
+				continue;
+			for (int z = cell.low.z; z <= cell.high.z; z++)
+				for (int y = cell.low.y; y <= cell.high.y; y++)
+					for (int x = cell.low.x; x <= cell.high.x; x++)
+						clusters[Index(x, y, z)].y++;
+		}
+		// prefix sum of the capped counts into list offsets, then a second pass writes the lists in light order
+		GLuint total = 0;
+		dropped = 0;
+		for (size_t c = 0; c < clusters.size(); c++)
+		{
+			clusters[c].x = total;
+			total += std::min(clusters[c].y, MAX_LIGHTS_PER_CLUSTER);
+			dropped += clusters[c].y - std::min(clusters[c].y, MAX_LIGHTS_PER_CLUSTER);
+			clusters[c].y = 0;
+		}
+		indices.resize(total);
+		for (size_t i = 0; i < lights.size(); i++)
+		{
+			const Cells& cell = cells[i];
+			if (!cell.touched)
+				continue;
+			for (int z = cell.low.z; z <= cell.high.z; z++)
+				for (int y = cell.low.y; y <= cell.high.y; y++)
+					for (int x = cell.low.x; x <= cell.high.x; x++)
+					{
+						glm::uvec2& cluster = clusters[Index(x, y, z)];
+						if (cluster.y < MAX_LIGHTS_PER_CLUSTER)
+							indices[cluster.x + cluster.y++] = (GLuint)i;
+					}
+		}
+	}
+	// the froxel a point at viewDepth and pixel (x, y), bottom-left origin, falls in, as the shaders compute it
+	// ------------------------------------------------------------------------
+	unsigned int ClusterAt(float x, float y, float viewDepth) const
+	{
+		unsigned int tileX = std::min((unsigned int)std::max(x / header.tile.x, 0.0f), TILES_X - 1);
+		unsigned int tileY = std::min((unsigned int)std::max(y / header.tile.y, 0.0f), TILES_Y - 1);
+		return Index((int)tileX, (int)tileY, Slice(viewDepth));
+	}
+	// longest light list of any froxel
+	// ------------------------------------------------------------------------
+	unsigned int MaxLightsPerCluster() const
+	{
+		unsigned int most = 0;
+		for (size_t c = 0; c < clusters.size(); c++)
+			most = std::max(most, clusters[c].y);
+		return most;
+	}
+	// most stream buffer bytes Upload() can take for lightCount lights, alignment padding included
+	// (GL caps the storage buffer offset alignment at 256)
+	// ------------------------------------------------------------------------
+	static size_t UploadBytes(size_t lightCount)
+	{
+		return std::max(lightCount, (size_t)1) * sizeof(ClusterLight) + sizeof(ClusterGridHeader) + CLUSTERS * sizeof(glm::uvec2)
+			+ (size_t)CLUSTERS * MAX_LIGHTS_PER_CLUSTER * sizeof(GLuint) + 3 * 256;
+	}
+	// write the lights, the grid and the lists into the stream buffer's current region and bind them to
+	// their storage block bindings. false when they do not fit, and nothing is bound then.
+	// ------------------------------------------------------------------------
+	bool Upload(StreamBuffer& stream) const
+	{
+		size_t lightBytes = std::max(lights.size(), (size_t)1) * sizeof(ClusterLight); // an empty range cannot be bound
+		size_t gridBytes = sizeof(ClusterGridHeader) + clusters.size() * sizeof(glm::uvec2);
+		size_t indexBytes = std::max(indices.size(), (size_t)1) * sizeof(GLuint);
+		StreamBuffer::Allocation lightData = stream.Allocate(lightBytes, stream.StorageAlignment());
+		StreamBuffer::Allocation gridData = stream.Allocate(gridBytes, stream.StorageAlignment());
+		StreamBuffer::Allocation indexData = stream.Allocate(indexBytes, stream.StorageAlignment());
+		if (!lightData.data || !gridData.data || !indexData.data)
+			return false;
+		if (!lights.empty())
+			std::memcpy(lightData.data, &lights[0], lights.size() * sizeof(ClusterLight));
+		std::memcpy(gridData.data, &header, sizeof(ClusterGridHeader));
+		if (!clusters.empty())
+			std::memcpy((unsigned char*)gridData.data + sizeof(ClusterGridHeader), &clusters[0], clusters.size() * sizeof(glm::uvec2));
+		if (!indices.empty())
+			std::memcpy(indexData.data, &indices[0], indices.size() * sizeof(GLuint));
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, LIGHT_BUFFER_BINDING, stream.buffer, lightData.offset, (GLsizeiptr)lightBytes);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, CLUSTER_GRID_BINDING, stream.buffer, gridData.offset, (GLsizeiptr)gridBytes);
+		glBindBufferRange(GL_SHADER_STORAGE_BUFFER, LIGHT_INDEX_BINDING, stream.buffer, indexData.offset, (GLsizeiptr)indexBytes);
+		return true;
+	}
+
+private:
+	struct Cells
+	{
+		glm::ivec3 low, high;
+		bool touched;
+	};
+	std::vector<Cells> cells;
+
+	static unsigned int Index(int x, int y, int z)
+	{
+		return ((unsigned int)z * TILES_Y + (unsigned int)y) * TILES_X + (unsigned int)x;
+	}
+	int Slice(float viewDepth) const
+	{
+		float slice = std::log(std::max(viewDepth, header.depth.x) / header.depth.x) * header.depth.z;
+		return std::min((int)slice, (int)SLICES - 1);
+	}
+	// conservative froxel box of one light, false when its sphere misses the view entirely
+	bool CellRange(const ClusterLight& light, const glm::mat4& view, const glm::mat4& projection, glm::ivec3& low, glm::ivec3& high) const
+	{
+		low = glm::ivec3(0);
+		high = glm::ivec3(TILES_X - 1, TILES_Y - 1, SLICES - 1);
+		float radius = light.positionRange.w;
+		if (radius <= 0.0f)
+			return true;
+		glm::vec3 center = glm::vec3(view * glm::vec4(glm::vec3(light.positionRange), 1.0f));
+		float nearest = -center.z - radius, farthest = -center.z + radius;
+		if (farthest < header.depth.x || nearest > header.depth.y)
+			return false;
+		low.z = Slice(nearest);
+		high.z = Slice(farthest);
+		// screen rectangle: the corners of the sphere's view-space box, projected. The box's image holds
+		// the sphere's as long as the whole box is in front of the eye; otherwise take every tile.
+		glm::vec2 lowNdc(1e30f), highNdc(-1e30f);
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec3 offset((corner & 1) ? radius : -radius, (corner & 2) ? radius : -radius, (corner & 4) ? radius : -radius);
+			glm::vec4 clip = projection * glm::vec4(center + offset, 1.0f);
+			if (clip.w <= 1e-4f)
+				return true;
+			glm::vec2 ndc = glm::vec2(clip) / clip.w;
+			lowNdc = glm::min(lowNdc, ndc);
+			highNdc = glm::max(highNdc, ndc);
+		}
+		if (highNdc.x < -1.0f || lowNdc.x > 1.0f || highNdc.y < -1.0f || lowNdc.y > 1.0f)
+			return false;
+		low.x = std::max((int)std::floor((lowNdc.x * 0.5f + 0.5f) * TILES_X), 0);
+		high.x = std::min((int)std::floor((highNdc.x * 0.5f + 0.5f) * TILES_X), (int)TILES_X - 1);
+		low.y = std::max((int)std::floor((lowNdc.y * 0.5f + 0.5f) * TILES_Y), 0);
+		high.y = std::min((int)std::floor((highNdc.y * 0.5f + 0.5f) * TILES_Y), (int)TILES_Y - 1);
+		return true;
+	}
+};
+#endif
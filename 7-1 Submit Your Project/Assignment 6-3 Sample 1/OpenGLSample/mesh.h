@@ -7,6 +7,11 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "shader.h"
+#include "culling.h"
+#include "mesh_optimizer.h"
+#include "meshlet.h"
+#include "mesh_simplify.h"
+#include "vertex_packing.h"
 
 #include <string>
 #include <vector>
@@ -25,6 +30,24 @@ struct Vertex {
 	glm::vec3 Bitangent;
 };
 
+// 24-byte GPU layout of Vertex, see vertex_packing.h for the encodings
+struct CompactVertex {
+	// position
+	glm::vec3 Position;
+	// octahedral normal, 2 x snorm16
+	glm::uint32 Normal;
+	// texCoords, 2 x half float
+	glm::uint32 TexCoords;
+	// tangent xyz in snorm10, bitangent sign in w
+	glm::uint32 Tangent;
+};
+
+// vertex buffer layout uploaded by setupMesh
+enum class VertexFormat {
+	Float,   // Vertex as-is, 56 bytes
+	Compact  // CompactVertex, 24 bytes: shaders decode the normal with octDecode and rebuild the bitangent
+};
+
 struct Texture {
 	unsigned int id;
 	string type;
@@ -37,21 +60,50 @@ public:
 	vector<Vertex>       vertices;
 	vector<unsigned int> indices;
 	vector<Texture>      textures;
+	VertexFormat         format;
+	Bounds               bounds; // object-space box and sphere, for frustum culling
+	vector<MeshLod>      lods;   // level 0 is the full mesh, coarser levels follow it in indices and share vertices
+	vector<Meshlet>      meshlets; // clusters of level 0, each a contiguous index range, for per-cluster culling
 	unsigned int VAO;
 
 	// constructor
-	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+	Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, VertexFormat format = VertexFormat::Float)
 	{
 		this->vertices = vertices;
 		this->indices = indices;
 		this->textures = textures;
+		this->format = format;
 
+		// reorder triangles for the post-transform cache and overdraw, then vertices for fetch locality
+		OptimizeMesh(this->indices, this->vertices, offsetof(Vertex, Position));
+		// cluster the triangles into meshlets, then append coarser levels of detail to the index buffer
+		meshlets = BuildMeshlets(this->indices, this->vertices.data(), this->vertices.size(), sizeof(Vertex), offsetof(Vertex, Position));
+		lods = GenerateLodChain(this->indices, this->vertices.data(), this->vertices.size(), sizeof(Vertex), offsetof(Vertex, Position));
 		// now that we have all the required data, set the vertex buffers and its attribute pointers.
 		setupMesh();
 	}
 
-	// render the mesh
-	void Draw(Shader &shader)
+	// constructor from a flat triangle list: identical vertices are welded into an index buffer first
+	Mesh(const vector<Vertex>& triangleList, vector<Texture> textures, VertexFormat format = VertexFormat::Float)
+	{
+		WeldVertices(triangleList, this->vertices, this->indices);
+		this->textures = textures;
+		this->format = format;
+
+		OptimizeMesh(this->indices, this->vertices, offsetof(Vertex, Position));
+		meshlets = BuildMeshlets(this->indices, this->vertices.data(), this->vertices.size(), sizeof(Vertex), offsetof(Vertex, Position));
+		lods = GenerateLodChain(this->indices, this->vertices.data(), this->vertices.size(), sizeof(Vertex), offsetof(Vertex, Position));
+		setupMesh();
+	}
+
+	// level of detail for a copy scaled by scale at distance from the camera, zoom is Camera::Zoom in degrees
+	size_t SelectLod(float scale, float distance, float zoom, float viewportHeight, float thresholdPixels = 1.0f) const
+	{
+		return ::SelectLod(lods, scale, distance, glm::radians(zoom), viewportHeight, thresholdPixels);
+	}
+
+	// render the mesh at one of its levels of detail
+	void Draw(Shader &shader, size_t lod = 0)
 	{
 		// bind appropriate textures
 		unsigned int diffuseNr = 1;
@@ -74,14 +126,15 @@ public:
 				number = std::to_string(heightNr++); // transfer unsigned int to stream
 
 			// now set the sampler to the correct texture unit
-			glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+			shader.setInt((name + number).c_str(), i);
 			// and finally bind the texture
 			glBindTexture(GL_TEXTURE_2D, textures[i].id);
 		}
 
 		// draw mesh
 		glBindVertexArray(VAO);
-		glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+		const MeshLod& level = lods[std::min(lod, lods.size() - 1)];
+		glDrawElements(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (void*)(level.firstIndex * sizeof(unsigned int)));
 		glBindVertexArray(0);
 
 		// always good practice to set everything back to defaults once configured.
@@ -95,6 +148,8 @@ private:
 	// initializes all the buffer objects/arrays
 	void setupMesh()
 	{
+		TRACE_ZONE("Mesh::setupMesh");
+		bounds = ComputeBounds(vertices.empty() ? NULL : &vertices[0].Position, vertices.size(), sizeof(Vertex)); // zero bounds for an empty mesh
 		// create buffers/arrays
 		glGenVertexArrays(1, &VAO);
 		glGenBuffers(1, &VBO);
@@ -103,30 +158,64 @@ private:
 		glBindVertexArray(VAO);
 		// load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
-		// A great thing about structs is that their memory layout is sequential for all its items.
-		// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
-		// again translates to 3/2 floats which translates to a byte array.
-		glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+		if (format == VertexFormat::Compact)
+		{
+			vector<CompactVertex> packed(vertices.size());
+			for (unsigned int i = 0; i < vertices.size(); i++)
+			{
+				packed[i].Position = vertices[i].Position;
+				packed[i].Normal = PackNormal(vertices[i].Normal);
+				packed[i].TexCoords = PackTexCoords(vertices[i].TexCoords);
+				packed[i].Tangent = PackTangentFrame(vertices[i].Normal, vertices[i].Tangent, vertices[i].Bitangent);
+			}
+			glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(CompactVertex), packed.data(), GL_STATIC_DRAW);
+		}
+		else
+		{
+			// A great thing about structs is that their memory layout is sequential for all its items.
+			// The effect is that we can simply pass a pointer to the struct and it translates perfectly to a glm::vec3/2 array which
+			// again translates to 3/2 floats which translates to a byte array.
+			glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), GL_STATIC_DRAW);
+		}
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), GL_STATIC_DRAW);
 
 		// set the vertex attribute pointers
-		// vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-		// vertex normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-		// vertex texture coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-		// vertex tangent
-		glEnableVertexAttribArray(3);
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
-		// vertex bitangent
-		glEnableVertexAttribArray(4);
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+		if (format == VertexFormat::Compact)
+		{
+			// vertex Positions
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)0);
+			// vertex normals, octahedral: the shader sees a vec2 in [-1, 1]
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, Normal));
+			// vertex texture coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, TexCoords));
+			// vertex tangent, w holds the bitangent sign; there is no separate bitangent attribute
+			glEnableVertexAttribArray(3);
+			glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(CompactVertex), (void*)offsetof(CompactVertex, Tangent));
+			glDisableVertexAttribArray(4);
+		}
+		else
+		{
+			// vertex Positions
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+			// vertex normals
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+			// vertex texture coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+			// vertex tangent
+			glEnableVertexAttribArray(3);
+			glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Tangent));
+			// vertex bitangent
+			glEnableVertexAttribArray(4);
+			glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
+		}
 
 		glBindVertexArray(0);
 	}
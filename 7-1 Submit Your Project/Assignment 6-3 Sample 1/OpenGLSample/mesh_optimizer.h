@@ -0,0 +1,313 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// CPU-side mesh preparation: vertex welding, triangle and vertex reordering, and post-transform
+// vertex cache statistics. Nothing here touches OpenGL, so it can run at load time or in an offline tool.
+
+// Results of replaying an index buffer through a simulated FIFO post-transform cache
+struct VertexCacheStats
+{
+	unsigned int transformed = 0; // vertex shader invocations (cache misses)
+	unsigned int triangles = 0;
+	float acmr = 0.0f;            // average cache miss ratio: transformed vertices per triangle (0.5 - 3.0)
+	float atvr = 0.0f;            // average transformed vertex ratio: transformed vertices per unique vertex (1.0 is ideal)
+	float hitRate = 0.0f;         // fraction of index fetches served by the cache
+};
+
+// Replays a triangle list through a FIFO cache of cacheSize entries, the model used by most GPUs
+// since the fixed-function era. Good enough to compare orderings without touching a GPU.
+inline VertexCacheStats SimulateVertexCache(const unsigned int* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = 16)
+{
+	VertexCacheStats stats;
+	if (indexCount == 0 || vertexCount == 0)
+		return stats;
+	std::vector<unsigned int> insertedAt(vertexCount, 0); // timestamp each vertex entered the FIFO, 0 = never
+	unsigned int timestamp = cacheSize + 1;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		unsigned int index = indices[i];
+		if (timestamp - insertedAt[index] > cacheSize) // not in the last cacheSize insertions: miss
+		{
+			insertedAt[index] = timestamp++;
+			stats.transformed++;
+		}
+	}
+	stats.triangles = (unsigned int)(indexCount / 3);
+	stats.acmr = stats.triangles ? (float)stats.transformed / stats.triangles : 0.0f;
+	stats.atvr = (float)stats.transformed / vertexCount;
+	stats.hitRate = 1.0f - (float)stats.transformed / indexCount;
+	return stats;
+}
+
+// Collapses bitwise identical vertices of a flat triangle list into a unique vertex array plus an
+// index buffer. Vertices are treated as vertexSize opaque bytes, so any interleaved layout works.
+// Returns the number of unique vertices; outVertices receives uniqueCount * vertexSize bytes.
+inline size_t WeldVertices(const void* vertices, size_t vertexCount, size_t vertexSize, std::vector<unsigned char>& outVertices, std::vector<unsigned int>& outIndices)
+{
+	const unsigned char* source = (const unsigned char*)vertices;
+	size_t tableSize = 1;
+	while (tableSize < vertexCount * 2)
+		tableSize <<= 1;
+	const unsigned int EMPTY = 0xFFFFFFFFu;
+	std::vector<unsigned int> table(tableSize, EMPTY); // open addressing, holds unique vertex numbers
+	outVertices.clear();
+	outVertices.reserve(vertexCount * vertexSize);
+	outIndices.resize(vertexCount);
+	size_t uniqueCount = 0;
+	for (size_t i = 0; i < vertexCount; i++)
+	{
+		const unsigned char* vertex = source + i * vertexSize;
+		size_t hash = 2166136261u; // FNV-1a over the raw vertex bytes
+		for (size_t b = 0; b < vertexSize; b++)
+			hash = (hash ^ vertex[b]) * 16777619u;
+		size_t slot = hash & (tableSize - 1);
+		while (table[slot] != EMPTY && std::memcmp(&outVertices[table[slot] * vertexSize], vertex, vertexSize) != 0)
+			slot = (slot + 1) & (tableSize - 1);
+		if (table[slot] == EMPTY)
+		{
+			table[slot] = (unsigned int)uniqueCount++;
+			outVertices.insert(outVertices.end(), vertex, vertex + vertexSize);
+		}
+		outIndices[i] = table[slot];
+	}
+	return uniqueCount;
+}
+
+// Typed convenience over WeldVertices for vertex structs such as mesh.h's Vertex
+template <typename VertexT>
+inline void WeldVertices(const std::vector<VertexT>& triangleList, std::vector<VertexT>& outVertices, std::vector<unsigned int>& outIndices)
+{
+	std::vector<unsigned char> bytes;
+	size_t uniqueCount = triangleList.empty() ? 0 : WeldVertices(&triangleList[0], triangleList.size(), sizeof(VertexT), bytes, outIndices);
+	outVertices.resize(uniqueCount);
+	if (uniqueCount)
+		std::memcpy(&outVertices[0], &bytes[0], bytes.size());
+}
+
+// Reorders triangles for post-transform cache locality with Tipsify (Sander, Nehab and Barczak,
+// "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw", 2007). Runs in linear time:
+// it fans around one vertex at a time and picks the next fanning vertex among the ones still in cache.
+inline std::vector<unsigned int> OptimizeVertexCache(const std::vector<unsigned int>& indices, size_t vertexCount, unsigned int cacheSize = 16)
+{
+	const size_t triangleCount = indices.size() / 3;
+	std::vector<unsigned int> result;
+	result.reserve(triangleCount * 3);
+	if (triangleCount == 0 || vertexCount == 0)
+		return result;
+	// vertex -> triangle adjacency in CSR form
+	std::vector<unsigned int> live(vertexCount, 0); // triangles not yet emitted that use each vertex
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		live[indices[i]]++;
+	std::vector<unsigned int> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + live[v];
+	std::vector<unsigned int> adjacency(triangleCount * 3);
+	std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++)
+		for (size_t c = 0; c < 3; c++)
+			adjacency[fill[indices[t * 3 + c]]++] = (unsigned int)t;
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<unsigned int> deadEnd; // recently referenced vertices, tried first when a fan runs dry
+	std::vector<unsigned int> candidates;
+	unsigned int timestamp = cacheSize + 1;
+	size_t cursor = 0; // next vertex to try once the dead-end stack is empty
+	long long fanning = 0;
+	while (fanning >= 0)
+	{
+		candidates.clear();
+		for (unsigned int a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+		{
+			unsigned int t = adjacency[a];
+			if (emitted[t])
+				continue;
+			for (size_t c = 0; c < 3; c++)
+			{
+				unsigned int v = indices[t * 3 + c];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (timestamp - cacheTime[v] > cacheSize)
+					cacheTime[v] = timestamp++;
+			}
+			emitted[t] = true;
+		}
+		// next fanning vertex: the candidate that will still be in cache after its remaining triangles, oldest first
+		fanning = -1;
+		int bestPriority = -1;
+		for (size_t i = 0; i < candidates.size(); i++)
+		{
+			unsigned int v = candidates[i];
+			if (live[v] == 0)
+				continue;
+			int priority = 0;
+			if (timestamp - cacheTime[v] + 2 * live[v] <= cacheSize)
+				priority = (int)(timestamp - cacheTime[v]);
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				fanning = v;
+			}
+		}
+		if (fanning >= 0)
+			continue;
+		while (!deadEnd.empty() && fanning < 0) // dead end: back up to a recently used vertex...
+		{
+			unsigned int v = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[v] > 0)
+				fanning = v;
+		}
+		while (cursor < vertexCount && fanning < 0) // ...or to the next vertex in input order
+		{
+			if (live[cursor] > 0)
+				fanning = (long long)cursor;
+			cursor++;
+		}
+	}
+	return result;
+}
+
+// Reorders whole clusters of an already cache-optimized triangle list so outward-facing clusters
+// draw first, which lets early-z reject more of the fragments behind them. A cluster ends wherever
+// the cache model starts over (all three vertices of a triangle miss), so reordering clusters keeps
+// the vertex cache behaviour; the new order is only kept if ACMR stays within threshold of the input.
+// Positions are read as 3 floats at positionOffset inside each vertexSize-byte vertex.
+inline std::vector<unsigned int> OptimizeOverdraw(const std::vector<unsigned int>& indices, const void* vertices, size_t vertexCount, size_t vertexSize, size_t positionOffset = 0, unsigned int cacheSize = 16, float threshold = 1.05f)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return indices;
+	const unsigned char* bytes = (const unsigned char*)vertices;
+	struct Float3 { float x, y, z; };
+	std::vector<Float3> positions(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		std::memcpy(&positions[v], bytes + v * vertexSize + positionOffset, sizeof(Float3));
+
+	// split into clusters where every vertex of a triangle misses the cache
+	std::vector<size_t> clusterStart;
+	std::vector<unsigned int> insertedAt(vertexCount, 0);
+	unsigned int timestamp = cacheSize + 1;
+	for (size_t t = 0; t < triangleCount; t++)
+	{
+		unsigned int misses = 0;
+		for (size_t c = 0; c < 3; c++)
+		{
+			unsigned int v = indices[t * 3 + c];
+			if (timestamp - insertedAt[v] > cacheSize)
+			{
+				insertedAt[v] = timestamp++;
+				misses++;
+			}
+		}
+		if (t == 0 || misses == 3)
+			clusterStart.push_back(t);
+	}
+	clusterStart.push_back(triangleCount);
+	if (clusterStart.size() <= 2)
+		return indices;
+
+	// mesh centroid, then per-cluster sort key dot(clusterCentroid - meshCentroid, clusterNormal)
+	Float3 meshCentroid = { 0.0f, 0.0f, 0.0f };
+	for (size_t i = 0; i < triangleCount * 3; i++)
+	{
+		meshCentroid.x += positions[indices[i]].x;
+		meshCentroid.y += positions[indices[i]].y;
+		meshCentroid.z += positions[indices[i]].z;
+	}
+	float inverseCount = 1.0f / (triangleCount * 3);
+	meshCentroid.x *= inverseCount;
+	meshCentroid.y *= inverseCount;
+	meshCentroid.z *= inverseCount;
+	const size_t clusterCount = clusterStart.size() - 1;
+	std::vector<std::pair<float, size_t>> order(clusterCount);
+	for (size_t k = 0; k < clusterCount; k++)
+	{
+		Float3 centroid = { 0.0f, 0.0f, 0.0f };
+		Float3 normal = { 0.0f, 0.0f, 0.0f }; // area weighted
+		for (size_t t = clusterStart[k]; t < clusterStart[k + 1]; t++)
+		{
+			const Float3& a = positions[indices[t * 3 + 0]];
+			const Float3& b = positions[indices[t * 3 + 1]];
+			const Float3& c = positions[indices[t * 3 + 2]];
+			Float3 e1 = { b.x - a.x, b.y - a.y, b.z - a.z };
+			Float3 e2 = { c.x - a.x, c.y - a.y, c.z - a.z };
+			normal.x += e1.y * e2.z - e1.z * e2.y;
+			normal.y += e1.z * e2.x - e1.x * e2.z;
+			normal.z += e1.x * e2.y - e1.y * e2.x;
+			centroid.x += a.x + b.x + c.x;
+			centroid.y += a.y + b.y + c.y;
+			centroid.z += a.z + b.z + c.z;
+		}
+		float scale = 1.0f / ((clusterStart[k + 1] - clusterStart[k]) * 3);
+		float dot = (centroid.x * scale - meshCentroid.x) * normal.x + (centroid.y * scale - meshCentroid.y) * normal.y + (centroid.z * scale - meshCentroid.z) * normal.z;
+		order[k] = std::make_pair(-dot, k); // most outward facing first
+	}
+	std::stable_sort(order.begin(), order.end());
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for (size_t k = 0; k < clusterCount; k++)
+	{
+		size_t cluster = order[k].second;
+		result.insert(result.end(), indices.begin() + clusterStart[cluster] * 3, indices.begin() + clusterStart[cluster + 1] * 3);
+	}
+	float before = SimulateVertexCache(&indices[0], indices.size(), vertexCount, cacheSize).acmr;
+	float after = SimulateVertexCache(&result[0], result.size(), vertexCount, cacheSize).acmr;
+	return after <= before * threshold ? result : indices;
+}
+
+// Reorders the vertex buffer into first-use order of the index buffer so vertex fetch walks memory
+// forward, and rewrites the indices to match. Unreferenced vertices are dropped; returns the new count.
+inline size_t OptimizeVertexFetch(std::vector<unsigned int>& indices, std::vector<unsigned char>& vertices, size_t vertexSize)
+{
+	const size_t vertexCount = vertices.size() / vertexSize;
+	const unsigned int UNUSED = 0xFFFFFFFFu;
+	std::vector<unsigned int> remap(vertexCount, UNUSED);
+	std::vector<unsigned char> reordered;
+	reordered.reserve(vertices.size());
+	unsigned int next = 0;
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		unsigned int& target = remap[indices[i]];
+		if (target == UNUSED)
+		{
+			target = next++;
+			reordered.insert(reordered.end(), vertices.begin() + indices[i] * vertexSize, vertices.begin() + (indices[i] + 1) * vertexSize);
+		}
+		indices[i] = target;
+	}
+	vertices.swap(reordered);
+	return next;
+}
+
+// Full load-time pipeline for an indexed mesh: triangle order for the post-transform cache,
+// cluster order for overdraw, then vertex order for fetch locality.
+inline void OptimizeMesh(std::vector<unsigned int>& indices, std::vector<unsigned char>& vertices, size_t vertexSize, size_t positionOffset = 0)
+{
+	const size_t vertexCount = vertices.size() / vertexSize;
+	if (indices.empty() || vertexCount == 0)
+		return;
+	indices = OptimizeVertexCache(indices, vertexCount);
+	indices = OptimizeOverdraw(indices, &vertices[0], vertexCount, vertexSize, positionOffset);
+	OptimizeVertexFetch(indices, vertices, vertexSize);
+}
+
+// Typed convenience over OptimizeMesh for vertex structs such as mesh.h's Vertex
+template <typename VertexT>
+inline void OptimizeMesh(std::vector<unsigned int>& indices, std::vector<VertexT>& vertices, size_t positionOffset = 0)
+{
+	if (indices.empty() || vertices.empty())
+		return;
+	std::vector<unsigned char> bytes((const unsigned char*)&vertices[0], (const unsigned char*)&vertices[0] + vertices.size() * sizeof(VertexT));
+	OptimizeMesh(indices, bytes, sizeof(VertexT), positionOffset);
+	vertices.resize(bytes.size() / sizeof(VertexT));
+	std::memcpy(&vertices[0], &bytes[0], bytes.size());
+}
+#endif
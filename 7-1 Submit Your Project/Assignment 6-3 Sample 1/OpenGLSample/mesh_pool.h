@@ -0,0 +1,170 @@
+#ifndef MESH_POOL_H
+#define MESH_POOL_H
+
+#if !defined(__glew_h__) && !defined(__glad_h_)
+#include <glad/glad.h> // holds all OpenGL type declarations (Source.cpp pulls in GLEW instead)
+#endif
+
+#include <vector>
+
+// Where a mesh lives inside a MeshPool. Indices are stored as the mesh was built (0-based),
+// baseVertex moves them to the mesh's vertices at draw time.
+struct MeshAllocation
+{
+	GLuint firstIndex = 0;
+	GLuint indexCount = 0;
+	GLint baseVertex = 0;
+	GLuint vertexCount = 0;
+};
+
+// Layout glMultiDrawElementsIndirect reads from GL_DRAW_INDIRECT_BUFFER, one per draw
+struct DrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+// One vertex buffer, one index buffer and one vertex array shared by every mesh of a vertex format.
+// Meshes are suballocated first-fit from free lists of vertex and index ranges, so switching mesh
+// is a change of firstIndex/baseVertex instead of a VAO bind, and a whole scene in one format can
+// go out in a single glMultiDrawElementsIndirect. Indices are 32-bit.
+class MeshPool
+{
+public:
+	GLuint VAO = 0;
+	GLuint VBO = 0;
+	GLuint EBO = 0;
+
+	// fixed-size immutable storage updated with glBufferSubData. The VAO is left bound with both
+	// buffers attached, so the caller describes the vertex format with glVertexAttribPointer next.
+	// ------------------------------------------------------------------------
+	void Create(GLsizei vertexStride, GLuint maxVertices, GLuint maxIndices)
+	{
+		stride = vertexStride;
+		glGenVertexArrays(1, &VAO);
+		glBindVertexArray(VAO);
+		glGenBuffers(1, &VBO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferStorage(GL_ARRAY_BUFFER, (GLsizeiptr)maxVertices * stride, NULL, GL_DYNAMIC_STORAGE_BIT);
+		glGenBuffers(1, &EBO); // The index buffer binding is recorded in the VAO
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)maxIndices * sizeof(GLuint), NULL, GL_DYNAMIC_STORAGE_BIT);
+		freeVertices.assign(1, Range{ 0, maxVertices });
+		freeIndices.assign(1, Range{ 0, maxIndices });
+	}
+	// copy a mesh into the pool, returns false when either buffer has no free range large enough
+	// ------------------------------------------------------------------------
+	bool Allocate(const void* vertices, GLuint vertexCount, const GLuint* indices, GLuint indexCount, MeshAllocation& allocation)
+	{
+		GLuint firstVertex = 0, firstIndex = 0;
+		if (!Take(freeVertices, vertexCount, firstVertex))
+			return false;
+		if (!Take(freeIndices, indexCount, firstIndex))
+		{
+			Give(freeVertices, firstVertex, vertexCount);
+			return false;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferSubData(GL_ARRAY_BUFFER, (GLintptr)firstVertex * stride, (GLsizeiptr)vertexCount * stride, vertices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, EBO); // not GL_ELEMENT_ARRAY_BUFFER, that would change whichever VAO is bound
+		glBufferSubData(GL_COPY_WRITE_BUFFER, (GLintptr)firstIndex * sizeof(GLuint), (GLsizeiptr)indexCount * sizeof(GLuint), indices);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		allocation.firstIndex = firstIndex;
+		allocation.indexCount = indexCount;
+		allocation.baseVertex = (GLint)firstVertex;
+		allocation.vertexCount = vertexCount;
+		usedVertices += vertexCount;
+		usedIndices += indexCount;
+		return true;
+	}
+	// return a mesh's ranges to the pool; draws already submitted that use them must have finished
+	// ------------------------------------------------------------------------
+	void Free(MeshAllocation& allocation)
+	{
+		if (allocation.vertexCount == 0 && allocation.indexCount == 0)
+			return;
+		Give(freeVertices, (GLuint)allocation.baseVertex, allocation.vertexCount);
+		Give(freeIndices, allocation.firstIndex, allocation.indexCount);
+		usedVertices -= allocation.vertexCount;
+		usedIndices -= allocation.indexCount;
+		allocation = MeshAllocation();
+	}
+	// the indirect command drawing a whole allocation
+	// ------------------------------------------------------------------------
+	static DrawElementsIndirectCommand Command(const MeshAllocation& allocation, GLuint instanceCount, GLuint baseInstance)
+	{
+		DrawElementsIndirectCommand command = { allocation.indexCount, instanceCount, allocation.firstIndex, allocation.baseVertex, baseInstance };
+		return command;
+	}
+	GLuint UsedVertices() const
+	{
+		return usedVertices;
+	}
+	GLuint UsedIndices() const
+	{
+		return usedIndices;
+	}
+	// ------------------------------------------------------------------------
+	void Destroy()
+	{
+		glDeleteVertexArrays(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteBuffers(1, &EBO);
+		VAO = VBO = EBO = 0;
+		freeVertices.clear();
+		freeIndices.clear();
+		usedVertices = usedIndices = 0;
+	}
+
+private:
+	struct Range
+	{
+		GLuint start;
+		GLuint count;
+	};
+
+	GLsizei stride = 0;
+	std::vector<Range> freeVertices; // sorted by start, neighbours always coalesced
+	std::vector<Range> freeIndices;
+	GLuint usedVertices = 0;
+	GLuint usedIndices = 0;
+
+	static bool Take(std::vector<Range>& ranges, GLuint count, GLuint& start)
+	{
+		for (size_t i = 0; i < ranges.size(); i++)
+		{
+			if (ranges[i].count < count)
+				continue;
+			start = ranges[i].start;
+			ranges[i].start += count;
+			ranges[i].count -= count;
+			if (ranges[i].count == 0)
+				ranges.erase(ranges.begin() + i);
+			return true;
+		}
+		return false;
+	}
+	static void Give(std::vector<Range>& ranges, GLuint start, GLuint count)
+	{
+		if (count == 0)
+			return;
+		size_t i = 0;
+		while (i < ranges.size() && ranges[i].start < start)
+			i++;
+		ranges.insert(ranges.begin() + i, Range{ start, count });
+		if (i + 1 < ranges.size() && ranges[i].start + ranges[i].count == ranges[i + 1].start)
+		{
+			ranges[i].count += ranges[i + 1].count;
+			ranges.erase(ranges.begin() + i + 1);
+		}
+		if (i > 0 && ranges[i - 1].start + ranges[i - 1].count == ranges[i].start)
+		{
+			ranges[i - 1].count += ranges[i].count;
+			ranges.erase(ranges.begin() + i);
+		}
+	}
+};
+#endif
@@ -0,0 +1,267 @@
+#ifndef MESH_SIMPLIFY_H
+#define MESH_SIMPLIFY_H
+
+#include <glm/glm.hpp>
+
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+// Level of detail generation with quadric error metrics (Garland and Heckbert, "Surface Simplification
+// Using Quadric Error Metrics", 1997). Collapses move a vertex onto one of its neighbours instead of
+// to a new optimal position, so every level indexes the original vertices and one vertex buffer
+// serves the whole chain. Nothing here touches OpenGL.
+
+// One level of a LOD chain: a range of the shared index buffer and how far, in object-space units,
+// its surface may be from the full-detail mesh
+struct MeshLod
+{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	float error;
+};
+
+// Sum of squared distances to a set of planes, as the symmetric 4x4 matrix in 10 doubles
+struct Quadric
+{
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+	static Quadric FromPlane(double a, double b, double c, double d)
+	{
+		Quadric q = { a * a, a * b, a * c, a * d, b * b, b * c, b * d, c * c, c * d, d * d };
+		return q;
+	}
+	void Add(const Quadric& other)
+	{
+		a2 += other.a2; ab += other.ab; ac += other.ac; ad += other.ad; b2 += other.b2;
+		bc += other.bc; bd += other.bd; c2 += other.c2; cd += other.cd; d2 += other.d2;
+	}
+	double Error(const glm::vec3& p) const
+	{
+		double x = p.x, y = p.y, z = p.z;
+		double error = a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x
+			+ b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y
+			+ c2 * z * z + 2.0 * cd * z + d2;
+		return std::max(error, 0.0);
+	}
+};
+
+// Simplifies an indexed triangle list towards targetIndexCount indices by collapsing edges in order of
+// increasing quadric error, stopping early rather than exceed maxError (object-space distance).
+// Vertices on open borders and on attribute seams (several vertices at one position) never move,
+// so borders stay closed and UVs and normals stay continuous; collapses that would flip a triangle
+// are rejected. Returns the new indices; error receives the largest error of any collapse made.
+// Positions are read as 3 floats at positionOffset inside each vertexSize-byte vertex.
+inline std::vector<unsigned int> SimplifyMesh(const std::vector<unsigned int>& indices, const void* vertices, size_t vertexCount, size_t vertexSize,
+	size_t positionOffset, size_t targetIndexCount, float maxError, float* error = NULL)
+{
+	const unsigned char* bytes = (const unsigned char*)vertices;
+	std::vector<glm::vec3> positions(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+		std::memcpy(&positions[i], bytes + i * vertexSize + positionOffset, sizeof(glm::vec3));
+	// vertices sharing a position share one quadric and one identity for border detection
+	std::vector<unsigned int> positionId(vertexCount);
+	std::vector<unsigned int> siblings(vertexCount, 0);
+	{
+		struct PositionHash
+		{
+			size_t operator()(const glm::vec3& p) const
+			{
+				glm::vec3 q = p + glm::vec3(0.0f); // -0 and +0 compare equal, so they must hash alike
+				unsigned int h[3];
+				std::memcpy(h, &q, sizeof(h));
+				return (h[0] * 73856093u) ^ (h[1] * 19349663u) ^ (h[2] * 83492791u);
+			}
+		};
+		std::unordered_map<glm::vec3, unsigned int, PositionHash> first;
+		for (size_t i = 0; i < vertexCount; i++)
+		{
+			unsigned int id = first.insert(std::make_pair(positions[i], (unsigned int)i)).first->second;
+			positionId[i] = id;
+			siblings[id]++;
+		}
+	}
+	std::vector<Quadric> quadrics(vertexCount, Quadric::FromPlane(0.0, 0.0, 0.0, 0.0));
+	std::unordered_map<unsigned long long, unsigned int> edgeUses;
+	for (size_t t = 0; t + 2 < indices.size(); t += 3)
+	{
+		const glm::vec3& p0 = positions[indices[t]];
+		glm::vec3 normal = glm::cross(positions[indices[t + 1]] - p0, positions[indices[t + 2]] - p0);
+		float length = glm::length(normal);
+		if (length > 0.0f)
+		{
+			normal /= length;
+			Quadric plane = Quadric::FromPlane(normal.x, normal.y, normal.z, -glm::dot(normal, p0));
+			for (int k = 0; k < 3; k++)
+				quadrics[positionId[indices[t + k]]].Add(plane);
+		}
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned long long a = positionId[indices[t + k]], b = positionId[indices[t + (k + 1) % 3]];
+			edgeUses[a < b ? (a << 32) | b : (b << 32) | a]++;
+		}
+	}
+	std::vector<bool> locked(vertexCount, false);
+	for (size_t i = 0; i < vertexCount; i++)
+		locked[i] = siblings[positionId[i]] > 1;
+	for (std::unordered_map<unsigned long long, unsigned int>::const_iterator edge = edgeUses.begin(); edge != edgeUses.end(); ++edge)
+		if (edge->second == 1) // an open border; positions of locked ids lock every vertex there
+			locked[(unsigned int)(edge->first >> 32)] = locked[(unsigned int)(edge->first & 0xffffffffu)] = true;
+	for (size_t i = 0; i < vertexCount; i++)
+		locked[i] = locked[i] || locked[positionId[i]];
+
+	struct Collapse
+	{
+		unsigned int from, to;
+		double cost;
+	};
+	std::vector<unsigned int> result(indices);
+	std::vector<Collapse> collapses;
+	std::vector<unsigned int> triangleStart, triangleList, remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	double largest = 0.0;
+	const double limit = (double)maxError * maxError;
+	while (result.size() > targetIndexCount)
+	{
+		// candidate collapses, each movable vertex onto each neighbour, cheapest first
+		collapses.clear();
+		for (size_t t = 0; t + 2 < result.size(); t += 3)
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int from = result[t + k];
+				if (locked[from])
+					continue;
+				for (int j = 1; j < 3; j++)
+				{
+					unsigned int to = result[t + (k + j) % 3];
+					Quadric sum = quadrics[positionId[from]];
+					sum.Add(quadrics[positionId[to]]);
+					Collapse collapse = { from, to, sum.Error(positions[to]) };
+					if (collapse.cost <= limit)
+						collapses.push_back(collapse);
+				}
+			}
+		if (collapses.empty())
+			break;
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.cost < y.cost; });
+		// vertex to triangle adjacency of the current indices, for the flip test
+		triangleStart.assign(vertexCount + 1, 0);
+		for (size_t i = 0; i < result.size(); i++)
+			triangleStart[result[i] + 1]++;
+		for (size_t v = 0; v < vertexCount; v++)
+			triangleStart[v + 1] += triangleStart[v];
+		triangleList.resize(result.size());
+		{
+			std::vector<unsigned int> fill(triangleStart.begin(), triangleStart.end() - 1);
+			for (size_t i = 0; i < result.size(); i++)
+				triangleList[fill[result[i]]++] = (unsigned int)(i / 3);
+		}
+		// apply as many as possible in one pass: no vertex takes part in two collapses, and stop once the
+		// triangles removed (about two per collapse) would reach the target
+		for (size_t v = 0; v < vertexCount; v++)
+			remap[v] = (unsigned int)v;
+		std::fill(touched.begin(), touched.end(), false);
+		size_t removable = (result.size() - targetIndexCount) / 3, removed = 0;
+		size_t applied = 0;
+		for (size_t c = 0; c < collapses.size() && removed < removable; c++)
+		{
+			const Collapse& collapse = collapses[c];
+			if (touched[collapse.from] || touched[collapse.to])
+				continue;
+			bool flips = false;
+			unsigned int dropped = 0;
+			for (unsigned int i = triangleStart[collapse.from]; i < triangleStart[collapse.from + 1] && !flips; i++)
+			{
+				const unsigned int* triangle = &result[triangleList[i] * 3];
+				if (triangle[0] == collapse.to || triangle[1] == collapse.to || triangle[2] == collapse.to)
+				{
+					dropped++;
+					continue;
+				}
+				glm::vec3 corners[3], moved[3];
+				for (int k = 0; k < 3; k++)
+				{
+					corners[k] = positions[triangle[k]];
+					moved[k] = triangle[k] == collapse.from ? positions[collapse.to] : corners[k];
+				}
+				glm::vec3 before = glm::cross(corners[1] - corners[0], corners[2] - corners[0]);
+				glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+				flips = glm::dot(before, after) <= 0.0f;
+			}
+			if (flips || dropped == 0)
+				continue; // not an edge any more, or it would fold the surface over
+			for (unsigned int i = triangleStart[collapse.from]; i < triangleStart[collapse.from + 1]; i++) // its neighbourhood changes shape
+			{
+				const unsigned int* triangle = &result[triangleList[i] * 3];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+			}
+			remap[collapse.from] = collapse.to;
+			quadrics[positionId[collapse.to]].Add(quadrics[positionId[collapse.from]]);
+			largest = std::max(largest, collapse.cost);
+			removed += dropped;
+			applied++;
+		}
+		if (applied == 0)
+			break;
+		size_t kept = 0;
+		for (size_t t = 0; t + 2 < result.size(); t += 3)
+		{
+			unsigned int a = remap[result[t]], b = remap[result[t + 1]], c = remap[result[t + 2]];
+			if (a == b || b == c || c == a)
+				continue;
+			result[kept++] = a;
+			result[kept++] = b;
+			result[kept++] = c;
+		}
+		result.resize(kept);
+	}
+	if (error)
+		*error = (float)std::sqrt(largest);
+	return result;
+}
+
+// Builds a LOD chain into indices: level 0 is the mesh as given, each further level has about ratio
+// times the triangles of the one before, simplified from it and reordered for the vertex cache.
+// All levels are appended to indices and index the same vertices. Stops after maxLevels, or once a
+// level can no longer shed a tenth of its triangles within maxError.
+inline std::vector<MeshLod> GenerateLodChain(std::vector<unsigned int>& indices, const void* vertices, size_t vertexCount, size_t vertexSize,
+	size_t positionOffset = 0, int maxLevels = 4, float ratio = 0.5f, float maxError = 1e30f)
+{
+	std::vector<MeshLod> lods;
+	MeshLod full = { 0, (unsigned int)indices.size(), 0.0f };
+	lods.push_back(full);
+	std::vector<unsigned int> previous(indices);
+	for (int level = 1; level < maxLevels && previous.size() >= 3; level++)
+	{
+		size_t target = (size_t)(previous.size() / 3 * ratio) * 3;
+		float levelError = 0.0f;
+		std::vector<unsigned int> simplified = SimplifyMesh(previous, vertices, vertexCount, vertexSize, positionOffset, target, maxError, &levelError);
+		if (simplified.empty() || simplified.size() > previous.size() * 9 / 10)
+			break;
+		simplified = OptimizeVertexCache(simplified, vertexCount);
+		MeshLod lod = { (unsigned int)indices.size(), (unsigned int)simplified.size(), lods.back().error + levelError }; // errors of successive levels add up at worst
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+		lods.push_back(lod);
+		previous.swap(simplified);
+	}
+	return lods;
+}
+
+// Coarsest level whose error, seen at distance through a perspective projection with vertical field
+// of view fovY (radians) on a viewport viewportHeight pixels tall, stays under thresholdPixels.
+// scale is the object's largest model-matrix scale, which scales the object-space error too.
+inline size_t SelectLod(const std::vector<MeshLod>& lods, float scale, float distance, float fovY, float viewportHeight, float thresholdPixels = 1.0f)
+{
+	float pixelsPerUnit = viewportHeight / (2.0f * std::tan(fovY * 0.5f) * std::max(distance, 1e-4f));
+	size_t chosen = 0;
+	for (size_t i = 1; i < lods.size(); i++)
+		if (lods[i].error * scale * pixelsPerUnit <= thresholdPixels)
+			chosen = i;
+	return chosen;
+}
+#endif
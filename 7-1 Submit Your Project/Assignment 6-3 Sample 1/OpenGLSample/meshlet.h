@@ -0,0 +1,180 @@
+#ifndef MESHLET_H
+#define MESHLET_H
+
+#include <glm/glm.hpp>
+
+#include "culling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// A small cluster of a mesh's triangles with the bounds needed to cull it on its own. Its triangles
+// are a contiguous range of the mesh's index buffer, so a visible cluster is one indirect draw command.
+struct Meshlet
+{
+	unsigned int firstIndex;
+	unsigned int indexCount;
+	unsigned int vertexCount; // distinct vertices referenced
+	glm::vec3 center; // bounding sphere, object space
+	float radius;
+	glm::vec3 coneApex; // every triangle faces away from a camera inside the cone behind the apex,
+	glm::vec3 coneAxis; // see MeshletVisible(); coneCutoff > 1 when the normals spread too wide for that
+	float coneCutoff;
+};
+
+// Splits an indexed triangle list into meshlets of at most maxVertices vertices and maxTriangles
+// triangles (64 and 124 fit the usual mesh shader and cache limits). Each meshlet grows from a seed
+// triangle by repeatedly adding the neighbouring triangle that brings in the fewest new vertices,
+// which keeps clusters compact and their spheres and cones tight. Reorders indices so every
+// meshlet is a contiguous range. Positions are read as 3 floats at positionOffset in each vertex.
+inline std::vector<Meshlet> BuildMeshlets(std::vector<unsigned int>& indices, const void* vertices, size_t vertexCount, size_t vertexSize,
+	size_t positionOffset = 0, unsigned int maxVertices = 64, unsigned int maxTriangles = 124)
+{
+	std::vector<Meshlet> meshlets;
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0)
+		return meshlets;
+	const unsigned char* bytes = (const unsigned char*)vertices;
+	std::vector<glm::vec3> positions(vertexCount);
+	for (size_t i = 0; i < vertexCount; i++)
+		std::memcpy(&positions[i], bytes + i * vertexSize + positionOffset, sizeof(glm::vec3));
+	// vertex to triangle adjacency
+	std::vector<unsigned int> triangleStart(vertexCount + 1, 0), triangleList(triangleCount * 3);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		triangleStart[indices[i] + 1]++;
+	for (size_t v = 0; v < vertexCount; v++)
+		triangleStart[v + 1] += triangleStart[v];
+	{
+		std::vector<unsigned int> fill(triangleStart.begin(), triangleStart.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++)
+			triangleList[fill[indices[i]]++] = (unsigned int)(i / 3);
+	}
+	std::vector<bool> used(triangleCount, false);
+	std::vector<int> slot(vertexCount, -1); // >= 0 while the vertex is in the meshlet being built
+	std::vector<unsigned int> members, triangles, reordered;
+	reordered.reserve(indices.size());
+	size_t seed = 0;
+	for (;;)
+	{
+		while (seed < triangleCount && used[seed])
+			seed++;
+		if (seed == triangleCount)
+			break;
+		members.clear();
+		triangles.clear();
+		size_t next = seed;
+		while (next != triangleCount)
+		{
+			used[next] = true;
+			triangles.push_back((unsigned int)next);
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[next * 3 + k];
+				if (slot[v] < 0)
+				{
+					slot[v] = (int)members.size();
+					members.push_back(v);
+				}
+			}
+			if (triangles.size() == maxTriangles)
+				break;
+			// best unused neighbour: fewest vertices not already in the meshlet, and still within the limit
+			next = triangleCount;
+			int fewest = 4;
+			for (size_t m = 0; m < members.size() && fewest > 0; m++)
+				for (unsigned int a = triangleStart[members[m]]; a < triangleStart[members[m] + 1]; a++)
+				{
+					unsigned int candidate = triangleList[a];
+					if (used[candidate])
+						continue;
+					int added = (slot[indices[candidate * 3]] < 0) + (slot[indices[candidate * 3 + 1]] < 0) + (slot[indices[candidate * 3 + 2]] < 0);
+					if (added < fewest && members.size() + added <= maxVertices)
+					{
+						fewest = added;
+						next = candidate;
+					}
+				}
+		}
+		Meshlet meshlet;
+		meshlet.firstIndex = (unsigned int)reordered.size();
+		meshlet.indexCount = (unsigned int)triangles.size() * 3;
+		meshlet.vertexCount = (unsigned int)members.size();
+		for (size_t t = 0; t < triangles.size(); t++)
+			for (int k = 0; k < 3; k++)
+				reordered.push_back(indices[triangles[t] * 3 + k]);
+		// sphere around the box center of the members
+		glm::vec3 low = positions[members[0]], high = low;
+		for (size_t m = 1; m < members.size(); m++)
+		{
+			low = glm::min(low, positions[members[m]]);
+			high = glm::max(high, positions[members[m]]);
+		}
+		meshlet.center = (low + high) * 0.5f;
+		float radiusSquared = 0.0f;
+		for (size_t m = 0; m < members.size(); m++)
+			radiusSquared = std::max(radiusSquared, glm::dot(positions[members[m]] - meshlet.center, positions[members[m]] - meshlet.center));
+		meshlet.radius = std::sqrt(radiusSquared);
+		// normal cone: the axis averages the face normals, the cutoff comes from the widest of them
+		glm::vec3 axis(0.0f);
+		std::vector<glm::vec3> normals(triangles.size());
+		for (size_t t = 0; t < triangles.size(); t++)
+		{
+			const glm::vec3& p0 = positions[indices[triangles[t] * 3]];
+			glm::vec3 normal = glm::cross(positions[indices[triangles[t] * 3 + 1]] - p0, positions[indices[triangles[t] * 3 + 2]] - p0);
+			float length = glm::length(normal);
+			normals[t] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+			axis += normals[t];
+		}
+		float axisLength = glm::length(axis);
+		meshlet.coneAxis = axisLength > 0.0f ? axis / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+		meshlet.coneApex = meshlet.center;
+		meshlet.coneCutoff = 2.0f;
+		float minimumDot = 1.0f;
+		for (size_t t = 0; t < triangles.size(); t++)
+			minimumDot = std::min(minimumDot, glm::dot(normals[t], meshlet.coneAxis));
+		if (axisLength > 0.0f && minimumDot > 0.1f)
+		{
+			// move the apex back along the axis until every triangle's plane is in front of it
+			float back = 0.0f;
+			for (size_t t = 0; t < triangles.size(); t++)
+			{
+				float along = glm::dot(normals[t], meshlet.coneAxis);
+				if (along > 0.0f)
+					back = std::max(back, glm::dot(meshlet.center - positions[indices[triangles[t] * 3]], normals[t]) / along);
+			}
+			meshlet.coneApex = meshlet.center - meshlet.coneAxis * back;
+			meshlet.coneCutoff = std::sqrt(1.0f - minimumDot * minimumDot);
+		}
+		for (size_t m = 0; m < members.size(); m++)
+			slot[members[m]] = -1;
+		meshlets.push_back(meshlet);
+	}
+	indices.swap(reordered);
+	return meshlets;
+}
+
+// false when a meshlet placed by model is outside the frustum, or when backfaceTest is set and the
+// camera at cameraPosition sees only the back of every triangle in it. scale is the model matrix's
+// largest axis scale. The cone test needs directions from a perspective eye, and it is skipped under
+// non-uniform scale, which bends normals.
+inline bool MeshletVisible(const Meshlet& meshlet, const glm::mat4& model, float scale, const Frustum& frustum, const glm::vec3& cameraPosition, bool backfaceTest)
+{
+	glm::vec3 center = glm::vec3(model * glm::vec4(meshlet.center, 1.0f));
+	float radius = meshlet.radius * scale;
+	for (int p = 0; p < 6; p++)
+		if (glm::dot(glm::vec3(frustum.planes[p]), center) + frustum.planes[p].w < -radius)
+			return false;
+	if (!backfaceTest || meshlet.coneCutoff > 1.0f)
+		return true;
+	glm::mat3 axes(model);
+	float smallest = std::min(glm::length(axes[0]), std::min(glm::length(axes[1]), glm::length(axes[2])));
+	if (smallest < scale * 0.999f)
+		return true;
+	glm::vec3 apex = glm::vec3(model * glm::vec4(meshlet.coneApex, 1.0f));
+	glm::vec3 axis = axes * meshlet.coneAxis / scale;
+	return glm::dot(glm::normalize(apex - cameraPosition), axis) < meshlet.coneCutoff;
+}
+#endif
@@ -0,0 +1,92 @@
+#ifndef NORMAL_MATRIX_H
+#define NORMAL_MATRIX_H
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define NORMAL_MATRIX_SSE
+#include <xmmintrin.h>
+#endif
+
+// Normal matrices, transpose(inverse(mat3(model))), computed once per object on the CPU instead of
+// once per vertex in the shader. The inverse transpose of a 3x3 matrix is its cofactor matrix divided
+// by the determinant, so no general inverse is needed. A singular model (zero scale on some axis)
+// yields its plain cofactor matrix, which still points normals the right way once renormalized.
+
+inline glm::mat3 NormalMatrix(const glm::mat4& model)
+{
+	const glm::vec3 a(model[0]), b(model[1]), c(model[2]); // columns of the upper-left 3x3
+	glm::mat3 cofactor(glm::cross(b, c), glm::cross(c, a), glm::cross(a, b));
+	float determinant = glm::dot(a, cofactor[0]);
+	if (determinant != 0.0f)
+		cofactor *= 1.0f / determinant;
+	return cofactor;
+}
+
+// Batch version for many objects. Matrices may sit inside larger records, so both arrays are walked
+// with a byte stride; pass sizeof(glm::mat4) / sizeof(glm::mat3) for tightly packed arrays. With SSE
+// four matrices are transposed into structure-of-arrays form and solved per lane.
+inline void ComputeNormalMatrices(const glm::mat4* models, size_t modelStride, glm::mat3* normals, size_t normalStride, size_t count)
+{
+	const unsigned char* source = (const unsigned char*)models;
+	unsigned char* destination = (unsigned char*)normals;
+	size_t i = 0;
+#ifdef NORMAL_MATRIX_SSE
+	for (; i + 4 <= count; i += 4)
+	{
+		// e[column * 3 + row] holds that element of all four matrices, one 4x4 transpose per column
+		__m128 e[9];
+		for (int column = 0; column < 3; column++)
+		{
+			__m128 c0 = _mm_loadu_ps((const float*)(source + (i + 0) * modelStride) + column * 4);
+			__m128 c1 = _mm_loadu_ps((const float*)(source + (i + 1) * modelStride) + column * 4);
+			__m128 c2 = _mm_loadu_ps((const float*)(source + (i + 2) * modelStride) + column * 4);
+			__m128 c3 = _mm_loadu_ps((const float*)(source + (i + 3) * modelStride) + column * 4);
+			_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+			e[column * 3 + 0] = c0;
+			e[column * 3 + 1] = c1;
+			e[column * 3 + 2] = c2;
+		}
+		// cofactor columns: cross(b, c), cross(c, a), cross(a, b) with a, b, c the model columns
+		__m128 r[9];
+		for (int column = 0; column < 3; column++)
+		{
+			const __m128* p = &e[((column + 1) % 3) * 3];
+			const __m128* q = &e[((column + 2) % 3) * 3];
+			r[column * 3 + 0] = _mm_sub_ps(_mm_mul_ps(p[1], q[2]), _mm_mul_ps(p[2], q[1]));
+			r[column * 3 + 1] = _mm_sub_ps(_mm_mul_ps(p[2], q[0]), _mm_mul_ps(p[0], q[2]));
+			r[column * 3 + 2] = _mm_sub_ps(_mm_mul_ps(p[0], q[1]), _mm_mul_ps(p[1], q[0]));
+		}
+		__m128 determinant = _mm_add_ps(_mm_add_ps(_mm_mul_ps(e[0], r[0]), _mm_mul_ps(e[1], r[1])), _mm_mul_ps(e[2], r[2]));
+		__m128 singular = _mm_cmpeq_ps(determinant, _mm_setzero_ps());
+		__m128 scale = _mm_div_ps(_mm_set1_ps(1.0f), _mm_or_ps(_mm_and_ps(singular, _mm_set1_ps(1.0f)), _mm_andnot_ps(singular, determinant)));
+		// transpose back to one xyz column per lane; the last column of each matrix is stored as 2 + 1
+		// floats so nothing past the end of the mat3 is written
+		for (int column = 0; column < 3; column++)
+		{
+			__m128 x = _mm_mul_ps(r[column * 3 + 0], scale);
+			__m128 y = _mm_mul_ps(r[column * 3 + 1], scale);
+			__m128 z = _mm_mul_ps(r[column * 3 + 2], scale);
+			__m128 w = _mm_setzero_ps();
+			_MM_TRANSPOSE4_PS(x, y, z, w);
+			__m128 lanes[4] = { x, y, z, w };
+			for (int lane = 0; lane < 4; lane++)
+			{
+				float* n = (float*)(destination + (i + lane) * normalStride) + column * 3;
+				if (column < 2)
+					_mm_storeu_ps(n, lanes[lane]); // the fourth float is overwritten by the next column
+				else
+				{
+					_mm_storel_pi((__m64*)n, lanes[lane]);
+					_mm_store_ss(n + 2, _mm_movehl_ps(lanes[lane], lanes[lane]));
+				}
+			}
+		}
+	}
+#endif
+	for (; i < count; i++)
+		*(glm::mat3*)(destination + i * normalStride) = NormalMatrix(*(const glm::mat4*)(source + i * modelStride));
+}
+#endif
@@ -0,0 +1,264 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <glm/glm.hpp>
+
+#include "culling.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define OCCLUSION_SSE
+#include <xmmintrin.h>
+#endif
+
+// Small CPU depth buffer for occlusion culling. A few low-poly occluders (table tops, walls, floors)
+// are rasterized into it each frame, then object bounds are tested against it before they are drawn.
+// Depth is NDC z, nearer is smaller, cleared to 1. Pixels are stored in 8x4 tiles so that a tile is
+// 32 contiguous floats, and Finish() keeps the farthest depth of every tile: a box nearer than that
+// is tested pixel by pixel, a box behind it is hidden by the whole tile without looking at a pixel.
+// Nothing touches the GPU, so the result is the same on every driver and needs no readback.
+// Occluders are rasterized inner-conservatively: a pixel is written only when the triangle covers all
+// of it, and it takes the farthest depth of the triangle over the pixel, so at 320x180 a silhouette
+// never hides what peeks past it. Seams between an occluder's own triangles are left open, which only
+// hides less. Every pixel holds one depth rather than the coverage masks and two depth layers of a
+// masked buffer: with only full coverage written, there are no partial pixels to merge.
+//   buffer.Clear(viewProjection); buffer.RenderOccluder(...) for each occluder; buffer.Finish();
+//   then buffer.TestBounds(world) for each object
+class OcclusionBuffer
+{
+public:
+	static const int TILE_WIDTH = 8;
+	static const int TILE_HEIGHT = 4;
+
+	// width and height are rounded up to whole tiles
+	// ------------------------------------------------------------------------
+	void Create(int bufferWidth, int bufferHeight)
+	{
+		tilesX = std::max(1, (bufferWidth + TILE_WIDTH - 1) / TILE_WIDTH);
+		tilesY = std::max(1, (bufferHeight + TILE_HEIGHT - 1) / TILE_HEIGHT);
+		width = tilesX * TILE_WIDTH;
+		height = tilesY * TILE_HEIGHT;
+		depth.assign((size_t)width * height, 1.0f);
+		tileMax.assign((size_t)tilesX * tilesY, 1.0f);
+	}
+	// start a frame seen through viewProjection
+	// ------------------------------------------------------------------------
+	void Clear(const glm::mat4& viewProjection)
+	{
+		transform = viewProjection;
+		std::fill(depth.begin(), depth.end(), 1.0f);
+		triangles = 0;
+	}
+	// rasterize an indexed triangle list, positions read with a byte stride as in ComputeBounds().
+	// Both windings are drawn, so occluders need not be closed or consistently wound.
+	// ------------------------------------------------------------------------
+	void RenderOccluder(const glm::vec3* positions, size_t vertexCount, size_t stride, const unsigned int* indices, size_t indexCount, const glm::mat4& model)
+	{
+		glm::mat4 modelViewProjection = transform * model;
+		const unsigned char* source = (const unsigned char*)positions;
+		clip.resize(vertexCount);
+		for (size_t i = 0; i < vertexCount; i++)
+			clip[i] = modelViewProjection * glm::vec4(*(const glm::vec3*)(source + i * stride), 1.0f);
+		for (size_t i = 0; i + 2 < indexCount; i += 3)
+			ClipAndDraw(clip[indices[i]], clip[indices[i + 1]], clip[indices[i + 2]]);
+	}
+	// build the per-tile farthest depths, call after the last occluder
+	// ------------------------------------------------------------------------
+	void Finish()
+	{
+		for (size_t tile = 0; tile < tileMax.size(); tile++)
+		{
+			const float* pixels = &depth[tile * TILE_WIDTH * TILE_HEIGHT];
+#ifdef OCCLUSION_SSE
+			__m128 farthest = _mm_loadu_ps(pixels);
+			for (int i = 4; i < TILE_WIDTH * TILE_HEIGHT; i += 4)
+				farthest = _mm_max_ps(farthest, _mm_loadu_ps(pixels + i));
+			farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+			farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+			tileMax[tile] = _mm_cvtss_f32(farthest);
+#else
+			tileMax[tile] = *std::max_element(pixels, pixels + TILE_WIDTH * TILE_HEIGHT);
+#endif
+		}
+	}
+	// false when every pixel the box covers on screen is behind an occluder. Boxes that reach the
+	// near plane are always visible; boxes off screen are not.
+	// ------------------------------------------------------------------------
+	bool TestBounds(const Bounds& world) const
+	{
+		float minX = 1e30f, minY = 1e30f, maxX = -1e30f, maxY = -1e30f, nearest = 1e30f;
+		glm::vec4 center = transform * glm::vec4(world.center, 1.0f); // corners are the center plus or minus the scaled axes, one transform instead of eight
+		glm::vec4 axisX = transform[0] * world.extents.x, axisY = transform[1] * world.extents.y, axisZ = transform[2] * world.extents.z;
+		for (int corner = 0; corner < 8; corner++)
+		{
+			glm::vec4 p = center + ((corner & 1) ? axisX : -axisX) + ((corner & 2) ? axisY : -axisY) + ((corner & 4) ? axisZ : -axisZ);
+			if (p.z < -p.w || p.w <= 0.0f)
+				return true;
+			float inverseW = 1.0f / p.w;
+			float x = p.x * inverseW, y = p.y * inverseW;
+			minX = std::min(minX, x);
+			maxX = std::max(maxX, x);
+			minY = std::min(minY, y);
+			maxY = std::max(maxY, y);
+			nearest = std::min(nearest, p.z * inverseW);
+		}
+		if (minX > 1.0f || maxX < -1.0f || minY > 1.0f || maxY < -1.0f)
+			return false;
+		int x0 = std::max(0, (int)std::floor((minX * 0.5f + 0.5f) * width)), x1 = std::min(width - 1, (int)std::ceil((maxX * 0.5f + 0.5f) * width));
+		int y0 = std::max(0, (int)std::floor((minY * 0.5f + 0.5f) * height)), y1 = std::min(height - 1, (int)std::ceil((maxY * 0.5f + 0.5f) * height));
+		for (int ty = y0 / TILE_HEIGHT; ty <= y1 / TILE_HEIGHT; ty++)
+			for (int tx = x0 / TILE_WIDTH; tx <= x1 / TILE_WIDTH; tx++)
+			{
+				if (tileMax[(size_t)ty * tilesX + tx] < nearest)
+					continue; // every pixel of the tile is in front of the box
+				int rowFirst = std::max(y0, ty * TILE_HEIGHT), rowLast = std::min(y1, ty * TILE_HEIGHT + TILE_HEIGHT - 1);
+				int columnFirst = std::max(x0, tx * TILE_WIDTH), columnLast = std::min(x1, tx * TILE_WIDTH + TILE_WIDTH - 1);
+				for (int y = rowFirst; y <= rowLast; y++)
+					for (int x = columnFirst; x <= columnLast; x++)
+						if (depth[Index(x, y)] >= nearest)
+							return true;
+			}
+		return false;
+	}
+	int Width() const
+	{
+		return width;
+	}
+	int Height() const
+	{
+		return height;
+	}
+	// triangles rasterized since Clear(), after near-plane clipping
+	unsigned int Triangles() const
+	{
+		return triangles;
+	}
+
+private:
+	struct ScreenVertex
+	{
+		float x, y, z;
+	};
+
+	int width = 0, height = 0;
+	int tilesX = 0, tilesY = 0;
+	std::vector<float> depth; // tile by tile, rows of TILE_WIDTH inside a tile
+	std::vector<float> tileMax;
+	std::vector<glm::vec4> clip;
+	glm::mat4 transform = glm::mat4(1.0f);
+	unsigned int triangles = 0;
+
+	size_t Index(int x, int y) const
+	{
+		return ((size_t)(y / TILE_HEIGHT) * tilesX + x / TILE_WIDTH) * (TILE_WIDTH * TILE_HEIGHT) + (y % TILE_HEIGHT) * TILE_WIDTH + x % TILE_WIDTH;
+	}
+	// clip a clip-space triangle against the near plane (z >= -w), which leaves zero, one or two triangles
+	void ClipAndDraw(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+	{
+		const glm::vec4* in[3] = { &a, &b, &c };
+		glm::vec4 polygon[4];
+		int count = 0;
+		for (int i = 0; i < 3; i++)
+		{
+			const glm::vec4& p = *in[i];
+			const glm::vec4& q = *in[(i + 1) % 3];
+			float dp = p.z + p.w, dq = q.z + q.w;
+			if (dp >= 0.0f)
+				polygon[count++] = p;
+			if ((dp >= 0.0f) != (dq >= 0.0f))
+				polygon[count++] = p + (q - p) * (dp / (dp - dq));
+		}
+		for (int i = 1; i + 1 < count; i++)
+			Draw(Project(polygon[0]), Project(polygon[i]), Project(polygon[i + 1]));
+	}
+	ScreenVertex Project(const glm::vec4& p) const
+	{
+		float w = std::max(p.w, 1e-6f);
+		ScreenVertex v = { (p.x / w * 0.5f + 0.5f) * width, (p.y / w * 0.5f + 0.5f) * height, p.z / w };
+		return v;
+	}
+	// half-space rasterizer, depth interpolated linearly in screen space (NDC z is). Edges and depth are
+	// evaluated at pixel centers but offset to their worst case over the whole pixel: over a 1x1 square
+	// a linear function a x + b y + c varies by at most (|a| + |b|) / 2 either way from its center value.
+	void Draw(ScreenVertex a, ScreenVertex b, ScreenVertex c)
+	{
+		float area = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+		if (std::fabs(area) < 1e-8f)
+			return;
+		if (area < 0.0f)
+		{
+			std::swap(b, c);
+			area = -area;
+		}
+		int x0 = std::max(0, (int)std::floor(std::min(a.x, std::min(b.x, c.x))));
+		int x1 = std::min(width - 1, (int)std::ceil(std::max(a.x, std::max(b.x, c.x))));
+		int y0 = std::max(0, (int)std::floor(std::min(a.y, std::min(b.y, c.y))));
+		int y1 = std::min(height - 1, (int)std::ceil(std::max(a.y, std::max(b.y, c.y))));
+		if (x0 > x1 || y0 > y1)
+			return;
+		triangles++;
+		x0 &= ~3; // whole groups of four, a group never straddles a tile row
+		// edge e(x, y) = A x + B y + C, positive inside for counter-clockwise triangles
+		const ScreenVertex* from[3] = { &a, &b, &c };
+		const ScreenVertex* to[3] = { &b, &c, &a };
+		float edgeA[3], edgeB[3], edgeC[3];
+		for (int e = 0; e < 3; e++)
+		{
+			edgeA[e] = from[e]->y - to[e]->y;
+			edgeB[e] = to[e]->x - from[e]->x;
+			edgeC[e] = -(edgeA[e] * from[e]->x + edgeB[e] * from[e]->y);
+			edgeC[e] -= 0.5f * (std::fabs(edgeA[e]) + std::fabs(edgeB[e])); // inside only when the whole pixel is
+		}
+		float dzdx = ((b.z - a.z) * (c.y - a.y) - (c.z - a.z) * (b.y - a.y)) / area;
+		float dzdy = ((c.z - a.z) * (b.x - a.x) - (b.z - a.z) * (c.x - a.x)) / area;
+		float z0 = a.z - dzdx * a.x - dzdy * a.y + 0.5f * (std::fabs(dzdx) + std::fabs(dzdy)); // farthest over the pixel
+#ifdef OCCLUSION_SSE
+		const __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+		const __m128 zero = _mm_setzero_ps();
+		__m128 stepA[3], stepB[3], stepC[3];
+		for (int e = 0; e < 3; e++)
+		{
+			stepA[e] = _mm_set1_ps(edgeA[e]);
+			stepB[e] = _mm_set1_ps(edgeB[e]);
+			stepC[e] = _mm_set1_ps(edgeC[e]);
+		}
+		const __m128 slopeX = _mm_set1_ps(dzdx), slopeY = _mm_set1_ps(dzdy), plane = _mm_set1_ps(z0);
+		for (int y = y0; y <= y1; y++)
+		{
+			__m128 py = _mm_set1_ps(y + 0.5f);
+			for (int x = x0; x <= x1; x += 4)
+			{
+				__m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane);
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(stepA[0], px), _mm_mul_ps(stepB[0], py)), stepC[0]), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(stepA[1], px), _mm_mul_ps(stepB[1], py)), stepC[1]), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(stepA[2], px), _mm_mul_ps(stepB[2], py)), stepC[2]), zero));
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+				float* pixels = &depth[Index(x, y)];
+				__m128 old = _mm_loadu_ps(pixels);
+				__m128 z = _mm_add_ps(_mm_add_ps(_mm_mul_ps(slopeX, px), _mm_mul_ps(slopeY, py)), plane);
+				__m128 nearer = _mm_min_ps(old, z);
+				_mm_storeu_ps(pixels, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+			}
+		}
+#else
+		for (int y = y0; y <= y1; y++)
+		{
+			float py = y + 0.5f;
+			for (int x = x0; x <= x1; x++)
+			{
+				float px = x + 0.5f;
+				if (edgeA[0] * px + edgeB[0] * py + edgeC[0] < 0.0f || edgeA[1] * px + edgeB[1] * py + edgeC[1] < 0.0f || edgeA[2] * px + edgeB[2] * py + edgeC[2] < 0.0f)
+					continue;
+				float& pixel = depth[Index(x, y)];
+				pixel = std::min(pixel, dzdx * px + dzdy * py + z0);
+			}
+		}
+#endif
+	}
+};
+#endif
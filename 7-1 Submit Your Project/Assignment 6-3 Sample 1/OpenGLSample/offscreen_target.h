@@ -0,0 +1,76 @@
+#ifndef OFFSCREEN_TARGET_H
+#define OFFSCREEN_TARGET_H
+
+#if !defined(__glew_h__) && !defined(__glad_h_)
+#include <glad/glad.h> // holds all OpenGL type declarations (Source.cpp pulls in GLEW instead)
+#endif
+
+#include <cstdio>
+#include <vector>
+
+// Color + depth framebuffer object of a fixed size, the render target of headless runs.
+// The color attachment can be read back and written out as a binary PPM.
+class OffscreenTarget
+{
+public:
+	GLuint FBO = 0;
+	GLuint colorBuffer = 0;
+	GLuint depthBuffer = 0;
+	int width = 0;
+	int height = 0;
+
+	// returns false when the driver reports the framebuffer incomplete
+	// ------------------------------------------------------------------------
+	bool Create(int targetWidth, int targetHeight)
+	{
+		width = targetWidth;
+		height = targetHeight;
+		glGenFramebuffers(1, &FBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glGenRenderbuffers(1, &colorBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+		glGenRenderbuffers(1, &depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		return complete;
+	}
+	// make the target current for drawing, sized viewport included
+	// ------------------------------------------------------------------------
+	void Bind() const
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		glViewport(0, 0, width, height);
+	}
+	// read the color attachment and write it as a binary PPM, top row first
+	// ------------------------------------------------------------------------
+	bool WritePPM(const char* path) const
+	{
+		std::vector<unsigned char> pixels((size_t)width * height * 3);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		FILE* file = std::fopen(path, "wb");
+		if (!file)
+			return false;
+		std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+		for (int y = height - 1; y >= 0; y--) // GL rows start at the bottom
+			std::fwrite(&pixels[(size_t)y * width * 3], 1, (size_t)width * 3, file);
+		return std::fclose(file) == 0;
+	}
+	// ------------------------------------------------------------------------
+	void Destroy()
+	{
+		glDeleteRenderbuffers(1, &colorBuffer);
+		glDeleteRenderbuffers(1, &depthBuffer);
+		glDeleteFramebuffers(1, &FBO);
+		FBO = colorBuffer = depthBuffer = 0;
+	}
+};
+#endif
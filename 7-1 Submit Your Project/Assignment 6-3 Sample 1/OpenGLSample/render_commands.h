@@ -0,0 +1,308 @@
+#ifndef RENDER_COMMANDS_H
+#define RENDER_COMMANDS_H
+
+#if !defined(__glew_h__) && !defined(__glad_h_)
+#include <glad/glad.h> // holds all OpenGL type declarations (Source.cpp pulls in GLEW instead)
+#endif
+
+#include <glm/glm.hpp>
+
+#include "frame_uniforms.h"
+#include "gl_state.h"
+#include "gpu_profiler.h"
+#include "instance_buffer.h"
+#include "light_clusters.h"
+#include "mesh_pool.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+// One recorded GL operation. Every command has the same fixed size and holds no pointers to
+// memory the recorder owns, so a frame is a flat array that is cleared and refilled in place.
+struct RenderCommand
+{
+	enum Type : unsigned char
+	{
+		CLEAR,              // a = mask, f = clear color
+		VIEWPORT,           // a = width, b = height
+		BIND_VERTEX_ARRAY,  // a = vertex array
+		USE_PROGRAM,        // a = program
+		BIND_TEXTURE,       // a = unit, b = texture
+		UNIFORM_2F,         // a = location, f = value
+		UNIFORM_3F,         // a = location, f = value
+		TEXTURE_WRAP,       // a = texture, b = wrap mode, f = border color
+		DRAW_INSTANCED,     // a = mode, b = index count, c = instance count, d = base instance
+		MULTI_DRAW_INDIRECT, // a = mode, b = first entry of the list's indirect commands, c = entry count
+		BEGIN_PASS,         // name = profiler pass, a string literal
+		END_PASS,
+		PROFILER_HUD        // a = framebuffer height
+	};
+
+	Type type;
+	GLuint a, b, c, d;
+	GLfloat f[4];
+	const char* name;
+};
+
+// Everything one frame needs from the thread that builds it: the FrameBlock contents, the binned lights, the instance
+// stream, the indirect draw commands and the GL commands in submission order. Reset() keeps every array's capacity, so once the
+// first few frames have sized them, recording a frame allocates nothing.
+class CommandList
+{
+public:
+	FrameUniforms frame;
+	LightClusters lights;
+	std::vector<InstanceData> instances;
+	std::vector<DrawElementsIndirectCommand> indirect;
+	std::vector<RenderCommand> commands;
+	// recorder-side counters, reported by whichever thread replays the list
+	int frameIndex = 0;
+	unsigned int ticks = 0;
+	unsigned int uniformCallsSaved = 0;
+	unsigned int stateChangesUnsorted = 0; // binds the draws would need in the order they were added
+	unsigned int stateChangesSorted = 0; // and in the order they were recorded
+	unsigned int objectsTested = 0; // against the view frustum
+	unsigned int objectsVisible = 0;
+	unsigned int objectsOccluded = 0; // of the visible ones, hidden behind occluders
+	unsigned int trianglesDrawn = 0; // at the levels of detail chosen
+	unsigned int trianglesFull = 0; // had every object been drawn at full detail
+	unsigned int clustersTested = 0; // meshlets of objects drawn at full detail
+	unsigned int clustersDrawn = 0;
+	unsigned int lightsMaxPerCluster = 0; // longest froxel light list, lights.indices holds them all
+	double droppedSeconds = 0.0;
+
+	// ------------------------------------------------------------------------
+	void Reset()
+	{
+		lights.Clear();
+		instances.clear();
+		indirect.clear();
+		commands.clear();
+	}
+	// append one instance and return its index, which is the base instance of its group
+	// ------------------------------------------------------------------------
+	GLuint AddInstance(const glm::mat4& model, const glm::vec4& color)
+	{
+		InstanceData instance;
+		instance.Model = model;
+		instance.Color = color;
+		instances.push_back(instance);
+		return (GLuint)instances.size() - 1;
+	}
+	// ------------------------------------------------------------------------
+	void Clear(GLbitfield mask, GLfloat r, GLfloat g, GLfloat b, GLfloat a)
+	{
+		RenderCommand& command = Push(RenderCommand::CLEAR);
+		command.a = mask;
+		command.f[0] = r;
+		command.f[1] = g;
+		command.f[2] = b;
+		command.f[3] = a;
+	}
+	void Viewport(int width, int height)
+	{
+		RenderCommand& command = Push(RenderCommand::VIEWPORT);
+		command.a = (GLuint)width;
+		command.b = (GLuint)height;
+	}
+	void BindVertexArray(GLuint vao)
+	{
+		Push(RenderCommand::BIND_VERTEX_ARRAY).a = vao;
+	}
+	void UseProgram(GLuint program)
+	{
+		Push(RenderCommand::USE_PROGRAM).a = program;
+	}
+	void BindTexture(GLuint unit, GLuint texture)
+	{
+		RenderCommand& command = Push(RenderCommand::BIND_TEXTURE);
+		command.a = unit;
+		command.b = texture;
+	}
+	void Uniform2fv(GLint location, const GLfloat* value)
+	{
+		RenderCommand& command = Push(RenderCommand::UNIFORM_2F);
+		command.a = (GLuint)location;
+		std::memcpy(command.f, value, 2 * sizeof(GLfloat));
+	}
+	void Uniform3fv(GLint location, const GLfloat* value)
+	{
+		RenderCommand& command = Push(RenderCommand::UNIFORM_3F);
+		command.a = (GLuint)location;
+		std::memcpy(command.f, value, 3 * sizeof(GLfloat));
+	}
+	// set both wrap axes of a 2D texture, borderColor is only used by GL_CLAMP_TO_BORDER
+	// ------------------------------------------------------------------------
+	void TextureWrap(GLuint texture, GLint mode, const GLfloat* borderColor)
+	{
+		RenderCommand& command = Push(RenderCommand::TEXTURE_WRAP);
+		command.a = texture;
+		command.b = (GLuint)mode;
+		std::memcpy(command.f, borderColor, 4 * sizeof(GLfloat));
+	}
+	void DrawInstanced(GLenum mode, GLuint indexCount, GLuint instanceCount, GLuint baseInstance)
+	{
+		RenderCommand& command = Push(RenderCommand::DRAW_INSTANCED);
+		command.a = mode;
+		command.b = indexCount;
+		command.c = instanceCount;
+		command.d = baseInstance;
+	}
+	// draw indirect entries [first, first + count) in one call
+	// ------------------------------------------------------------------------
+	void MultiDrawIndirect(GLenum mode, GLuint first, GLuint count)
+	{
+		RenderCommand& command = Push(RenderCommand::MULTI_DRAW_INDIRECT);
+		command.a = mode;
+		command.b = first;
+		command.c = count;
+	}
+	void BeginPass(const char* name)
+	{
+		Push(RenderCommand::BEGIN_PASS).name = name;
+	}
+	void EndPass()
+	{
+		Push(RenderCommand::END_PASS);
+	}
+	void ProfilerHUD(int framebufferHeight)
+	{
+		Push(RenderCommand::PROFILER_HUD).a = (GLuint)framebufferHeight;
+	}
+	// issue the commands on the thread that owns the context and return the number of draw calls.
+	// The frame uniforms, lights, instances and indirect commands are uploaded by the caller first, the
+	// indirect ones at indirectOffset in the buffer bound at GL_DRAW_INDIRECT_BUFFER.
+	// ------------------------------------------------------------------------
+	unsigned int Replay(GLStateCache& state, GPUProfiler& profiler, GLintptr indirectOffset = 0) const
+	{
+		unsigned int draws = 0;
+		for (size_t i = 0; i < commands.size(); i++)
+		{
+			const RenderCommand& command = commands[i];
+			switch (command.type)
+			{
+			case RenderCommand::CLEAR:
+				state.ClearColor(command.f[0], command.f[1], command.f[2], command.f[3]);
+				glClear(command.a);
+				break;
+			case RenderCommand::VIEWPORT:
+				glViewport(0, 0, (GLsizei)command.a, (GLsizei)command.b);
+				break;
+			case RenderCommand::BIND_VERTEX_ARRAY:
+				state.BindVertexArray(command.a);
+				break;
+			case RenderCommand::USE_PROGRAM:
+				state.UseProgram(command.a);
+				break;
+			case RenderCommand::BIND_TEXTURE:
+				state.BindTexture(command.a, command.b);
+				break;
+			case RenderCommand::UNIFORM_2F:
+				state.Uniform2fv((GLint)command.a, command.f);
+				break;
+			case RenderCommand::UNIFORM_3F:
+				state.Uniform3fv((GLint)command.a, command.f);
+				break;
+			case RenderCommand::TEXTURE_WRAP:
+				state.BindTexture(0, command.a);
+				if (command.b == GL_CLAMP_TO_BORDER)
+					glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, command.f);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, (GLint)command.b);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, (GLint)command.b);
+				break;
+			case RenderCommand::DRAW_INSTANCED:
+				glDrawElementsInstancedBaseInstance(command.a, (GLsizei)command.b, GL_UNSIGNED_INT, 0, (GLsizei)command.c, command.d);
+				draws++;
+				break;
+			case RenderCommand::MULTI_DRAW_INDIRECT:
+				glMultiDrawElementsIndirect(command.a, GL_UNSIGNED_INT, (const void*)(indirectOffset + command.b * sizeof(DrawElementsIndirectCommand)), (GLsizei)command.c, 0);
+				draws++;
+				break;
+			case RenderCommand::BEGIN_PASS:
+				profiler.Begin(command.name);
+				break;
+			case RenderCommand::END_PASS:
+				profiler.End();
+				break;
+			case RenderCommand::PROFILER_HUD:
+				profiler.DrawHUD(state, (int)command.a);
+				break;
+			}
+		}
+		return draws;
+	}
+
+private:
+	RenderCommand& Push(RenderCommand::Type type)
+	{
+		commands.push_back(RenderCommand());
+		commands.back().type = type;
+		return commands.back();
+	}
+};
+
+// Hands recorded frames from the thread that builds them to the thread that owns the GL context.
+// There are two lists: while one is replayed the next frame is recorded into the other, and the
+// recorder only waits when it is a whole frame ahead of the renderer. With no render thread the
+// same calls run back to back on one thread and never wait.
+//   recorder: CommandList& list = queue.BeginRecord(); ...fill list...; queue.Submit();
+//   renderer: while (const CommandList* list = queue.Acquire()) { ...replay...; queue.Release(); }
+class RenderQueue
+{
+public:
+	// ------------------------------------------------------------------------
+	CommandList& BeginRecord()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return submitted - released < 2; });
+		CommandList& list = lists[submitted % 2];
+		list.Reset();
+		return list;
+	}
+	// ------------------------------------------------------------------------
+	void Submit()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			submitted++;
+		}
+		changed.notify_all();
+	}
+	// the oldest submitted list, or NULL once Stop() was called and every list has been replayed
+	// ------------------------------------------------------------------------
+	const CommandList* Acquire()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		changed.wait(lock, [this] { return submitted != released || stopping; });
+		return submitted != released ? &lists[released % 2] : NULL;
+	}
+	// ------------------------------------------------------------------------
+	void Release()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			released++;
+		}
+		changed.notify_all();
+	}
+	// ------------------------------------------------------------------------
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		changed.notify_all();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable changed;
+	CommandList lists[2];
+	unsigned long long submitted = 0;
+	unsigned long long released = 0;
+	bool stopping = false;
+};
+#endif
@@ -5,6 +5,9 @@
 
 #include <glm/glm.hpp>
 
+#include "uniform_cache.h"
+#include "trace.h"
+
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -14,10 +17,12 @@ class Shader
 {
 public:
 	unsigned int ID;
+	UniformCache uniforms; // active uniform locations, filled once at link time
 	// constructor generates the shader on the fly
 	// ------------------------------------------------------------------------
 	Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
 	{
+		TRACE_ZONE("Shader::Shader");
 		// 1. retrieve the vertex/fragment source code from filePath
 		std::string vertexCode;
 		std::string fragmentCode;
@@ -90,6 +95,7 @@ public:
 			glAttachShader(ID, geometry);
 		glLinkProgram(ID);
 		checkCompileErrors(ID, "PROGRAM");
+		uniforms.Reflect(ID);
 		// delete the shaders as they're linked into our program now and no longer necessery
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
@@ -103,63 +109,63 @@ public:
 	{
 		glUseProgram(ID);
 	}
-	// utility uniform functions
+	// utility uniform functions, names are taken as const char* so string literals reach the cache without a std::string
 	// ------------------------------------------------------------------------
-	void setBool(const std::string &name, bool value) const
+	void setBool(const char* name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+		glUniform1i(uniforms.Location(name), (int)value);
 	}
 	// ------------------------------------------------------------------------
-	void setInt(const std::string &name, int value) const
+	void setInt(const char* name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1i(uniforms.Location(name), value);
 	}
 	// ------------------------------------------------------------------------
-	void setFloat(const std::string &name, float value) const
+	void setFloat(const char* name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		glUniform1f(uniforms.Location(name), value);
 	}
 	// ------------------------------------------------------------------------
-	void setVec2(const std::string &name, const glm::vec2 &value) const
+	void setVec2(const char* name, const glm::vec2 &value) const
 	{
-		glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform2fv(uniforms.Location(name), 1, &value[0]);
 	}
-	void setVec2(const std::string &name, float x, float y) const
+	void setVec2(const char* name, float x, float y) const
 	{
-		glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y);
+		glUniform2f(uniforms.Location(name), x, y);
 	}
 	// ------------------------------------------------------------------------
-	void setVec3(const std::string &name, const glm::vec3 &value) const
+	void setVec3(const char* name, const glm::vec3 &value) const
 	{
-		glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform3fv(uniforms.Location(name), 1, &value[0]);
 	}
-	void setVec3(const std::string &name, float x, float y, float z) const
+	void setVec3(const char* name, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		glUniform3f(uniforms.Location(name), x, y, z);
 	}
 	// ------------------------------------------------------------------------
-	void setVec4(const std::string &name, const glm::vec4 &value) const
+	void setVec4(const char* name, const glm::vec4 &value) const
 	{
-		glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]);
+		glUniform4fv(uniforms.Location(name), 1, &value[0]);
 	}
-	void setVec4(const std::string &name, float x, float y, float z, float w)
+	void setVec4(const char* name, float x, float y, float z, float w)
 	{
-		glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w);
+		glUniform4f(uniforms.Location(name), x, y, z, w);
 	}
 	// ------------------------------------------------------------------------
-	void setMat2(const std::string &name, const glm::mat2 &mat) const
+	void setMat2(const char* name, const glm::mat2 &mat) const
 	{
-		glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix2fv(uniforms.Location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
-	void setMat3(const std::string &name, const glm::mat3 &mat) const
+	void setMat3(const char* name, const glm::mat3 &mat) const
 	{
-		glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix3fv(uniforms.Location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 	// ------------------------------------------------------------------------
-	void setMat4(const std::string &name, const glm::mat4 &mat) const
+	void setMat4(const char* name, const glm::mat4 &mat) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+		glUniformMatrix4fv(uniforms.Location(name), 1, GL_FALSE, &mat[0][0]);
 	}
 
 private:
@@ -268,17 +274,17 @@ private:
 //	}
 //	// utility uniform functions
 //	// ------------------------------------------------------------------------
-//	void setBool(const std::string &name, bool value) const
+//	void setBool(const char* name, bool value) const
 //	{
 //		glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
 //	}
 //	// ------------------------------------------------------------------------
-//	void setInt(const std::string &name, int value) const
+//	void setInt(const char* name, int value) const
 //	{
 //		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
 //	}
 //	// ------------------------------------------------------------------------
-//	void setFloat(const std::string &name, float value) const
+//	void setFloat(const char* name, float value) const
 //	{
 //		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
 //	}
@@ -1,4 +1,4 @@
-#version 330 core
+#version 440 core
 out vec4 FragColor;
 
 struct Material {
@@ -15,16 +15,12 @@ struct DirLight {
     vec3 specular;
 };
 
-struct PointLight {
-    vec3 position;
-    
-    float constant;
-    float linear;
-    float quadratic;
-	
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+// point lights come binned into view-space froxels (light_clusters.h), so each fragment only
+// evaluates the lights listed for its own froxel instead of every light in the scene
+struct ClusterLight {
+    vec4 positionRange; // range 0: no falloff
+    vec4 color;
+    vec4 shading; // specular strength, highlight size, diffuse floor, ambient strength
 };
 
 struct SpotLight {
@@ -42,28 +38,49 @@ struct SpotLight {
     vec3 specular;       
 };
 
-#define NR_POINT_LIGHTS 4
-
 in vec3 FragPos;
 in vec3 Normal;
 in vec2 TexCoords;
 
-uniform vec3 viewPos;
+layout(std140, binding = 0) uniform FrameBlock // per-frame camera and light state shared with Source.cpp
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+    vec3 keyLightColor;
+    vec3 keyLightPos;
+    vec3 fillLightColor;
+    vec3 fillLightPos;
+};
+layout(std430, binding = 1) readonly buffer LightBlock
+{
+    ClusterLight lights[];
+};
+layout(std430, binding = 2) readonly buffer ClusterGrid
+{
+    uvec4 clusterSize; // tiles across, tiles down, depth slices, light count
+    vec4 clusterDepth; // near, far, slices / log(far / near)
+    vec4 clusterTile; // tile size in pixels
+    uvec2 clusterLights[]; // first entry in lightIndices, count
+};
+layout(std430, binding = 3) readonly buffer LightIndexBlock
+{
+    uint lightIndices[];
+};
 uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
 uniform SpotLight spotLight;
 uniform Material material;
 
 // function prototypes
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcPointLight(ClusterLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 vec3 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 void main()
 {    
     // properties
     vec3 norm = normalize(Normal);
-    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 viewDir = normalize(viewPosition - FragPos);
     
     // == =====================================================
     // Our lighting is set up in 3 phases: directional, point lights and an optional flashlight
@@ -73,9 +90,12 @@ void main()
     // == =====================================================
     // phase 1: directional lighting
     vec3 result = CalcDirLight(dirLight, norm, viewDir);
-    // phase 2: point lights
-    for(int i = 0; i < NR_POINT_LIGHTS; i++)
-        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);    
+    // phase 2: point lights, only those binned into this fragment's froxel
+    float viewDepth = -(view * vec4(FragPos, 1.0)).z;
+    uvec3 cell = min(uvec3(uvec2(gl_FragCoord.xy / clusterTile.xy), uint(max(log(viewDepth / clusterDepth.x) * clusterDepth.z, 0.0))), clusterSize.xyz - 1u);
+    uvec2 range = clusterLights[(cell.z * clusterSize.y + cell.y) * clusterSize.x + cell.x];
+    for(uint i = range.x; i < range.x + range.y; i++)
+        result += CalcPointLight(lights[lightIndices[i]], norm, FragPos, viewDir);
     // phase 3: spot light
     result += CalcSpotLight(spotLight, norm, FragPos, viewDir);    
     
@@ -99,21 +119,26 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 }
 
 // calculates the color when using a point light.
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
+vec3 CalcPointLight(ClusterLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 {
-    vec3 lightDir = normalize(light.position - fragPos);
+    vec3 lightDir = normalize(light.positionRange.xyz - fragPos);
     // diffuse shading
-    float diff = max(dot(normal, lightDir), 0.0);
+    float diff = max(dot(normal, lightDir), light.shading.z);
     // specular shading
     vec3 reflectDir = reflect(-lightDir, normal);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    // attenuation
-    float distance = length(light.position - fragPos);
-    float attenuation = 1.0 / (light.constant + light.linear * distance + light.quadratic * (distance * distance));    
+    // attenuation: a window that reaches zero at the light's range, where its froxels stop
+    float distance = length(light.positionRange.xyz - fragPos);
+    float attenuation = 1.0;
+    if (light.positionRange.w > 0.0)
+    {
+        float falloff = clamp(1.0 - pow(distance / light.positionRange.w, 4.0), 0.0, 1.0);
+        attenuation = falloff * falloff;
+    }
     // combine results
-    vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoords));
-    vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoords));
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
+    vec3 ambient = light.shading.w * light.color.rgb * vec3(texture(material.diffuse, TexCoords));
+    vec3 diffuse = light.color.rgb * diff * vec3(texture(material.diffuse, TexCoords));
+    vec3 specular = light.shading.x * light.color.rgb * spec * vec3(texture(material.specular, TexCoords));
     ambient *= attenuation;
     diffuse *= attenuation;
     specular *= attenuation;
@@ -1,4 +1,4 @@
-#version 330 core
+#version 440 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
@@ -7,14 +7,23 @@ out vec3 FragPos;
 out vec3 Normal;
 out vec2 TexCoords;
 
+layout(std140, binding = 0) uniform FrameBlock // per-frame camera and light state shared with Source.cpp
+{
+    mat4 view;
+    mat4 projection;
+    vec3 viewPosition;
+    vec3 keyLightColor;
+    vec3 keyLightPos;
+    vec3 fillLightColor;
+    vec3 fillLightPos;
+};
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+uniform mat3 normalMatrix; // transpose(inverse(mat3(model))), once per object on the CPU: loaders must call shader.setMat3("normalMatrix", NormalMatrix(model)) (normal_matrix.h)
 
 void main()
 {
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+    Normal = normalMatrix * aNormal;
     TexCoords = aTexCoords;
     
     gl_Position = projection * view * vec4(FragPos, 1.0);
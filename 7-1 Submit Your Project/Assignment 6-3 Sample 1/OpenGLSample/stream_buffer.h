@@ -0,0 +1,161 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#if !defined(__glew_h__) && !defined(__glad_h_)
+#include <glad/glad.h> // holds all OpenGL type declarations (Source.cpp pulls in GLEW instead)
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+
+// Transient per-frame data in one persistently mapped buffer: uniform blocks, light lists, instance data,
+// indirect commands, anything written once by the CPU and read by the GPU in the same frame.
+// The buffer is cut into REGIONS equal regions used round robin. Allocate() bumps a pointer in the
+// current region and returns memory to write straight into; EndFrame() fences the region and
+// BeginFrame() waits on the fence of the region it is about to reuse. The buffer is untyped, so
+// bind it to whatever target the data is for at the returned offset.
+// With three regions the CPU may run two frames ahead. When it gets further the wait in BeginFrame()
+// is a stall, counted and timed so the render loop can warn and the profiler can show it.
+class StreamBuffer
+{
+public:
+	static const int REGIONS = 3;
+
+	struct Allocation
+	{
+		void* data; // NULL when the region is full
+		GLintptr offset; // from the start of the buffer
+	};
+
+	// stalls and allocation failures since the last TakeStats()
+	struct Stats
+	{
+		unsigned int stalls = 0;
+		double stallMs = 0.0;
+		unsigned int failedAllocations = 0;
+		size_t peakBytes = 0; // most bytes used by one frame
+	};
+
+	GLuint buffer = 0;
+
+	// returns false when the driver refuses the persistent mapping
+	// ------------------------------------------------------------------------
+	bool Create(size_t bytesPerFrame)
+	{
+		regionSize = bytesPerFrame;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_COPY_WRITE_BUFFER, (GLsizeiptr)(regionSize * REGIONS), NULL, flags);
+		mapped = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, (GLsizeiptr)(regionSize * REGIONS), flags);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		uniformAlignment = (size_t)std::max(alignment, 1);
+		alignment = 256;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		storageAlignment = (size_t)std::max(alignment, 1);
+		for (int i = 0; i < REGIONS; i++)
+			fences[i] = 0;
+		region = 0;
+		head = 0;
+		return mapped != NULL;
+	}
+	// move to the next region, waiting for the GPU to finish reading it if it has not yet
+	// ------------------------------------------------------------------------
+	void BeginFrame()
+	{
+		region = (region + 1) % REGIONS;
+		head = 0;
+		lastStallMs = 0.0;
+		GLsync& fence = fences[region];
+		if (!fence)
+			return;
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			Clock::time_point start = Clock::now();
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) // 1 ms at a time
+				;
+			lastStallMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+			stats.stalls++;
+			stats.stallMs += lastStallMs;
+		}
+		glDeleteSync(fence);
+		fence = 0;
+	}
+	// bytes in the current region, offset rounded up to a multiple of alignment (any value, not only powers of two)
+	// ------------------------------------------------------------------------
+	Allocation Allocate(size_t bytes, size_t alignment = 16)
+	{
+		size_t base = region * regionSize;
+		size_t offset = (base + head + alignment - 1) / alignment * alignment;
+		if (offset + bytes > base + regionSize)
+		{
+			stats.failedAllocations++;
+			Allocation none = { NULL, 0 };
+			return none;
+		}
+		head = offset + bytes - base;
+		stats.peakBytes = std::max(stats.peakBytes, head);
+		Allocation allocation = { mapped + offset, (GLintptr)offset };
+		return allocation;
+	}
+	// fence everything submitted since BeginFrame(), call after the frame's last draw that reads the buffer
+	// ------------------------------------------------------------------------
+	void EndFrame()
+	{
+		fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	size_t UniformAlignment() const
+	{
+		return uniformAlignment;
+	}
+	size_t StorageAlignment() const
+	{
+		return storageAlignment;
+	}
+	// time the latest BeginFrame() spent waiting, 0 when it did not stall
+	double LastStallMs() const
+	{
+		return lastStallMs;
+	}
+	// ------------------------------------------------------------------------
+	Stats TakeStats()
+	{
+		Stats taken = stats;
+		stats = Stats();
+		return taken;
+	}
+	// ------------------------------------------------------------------------
+	void Destroy()
+	{
+		for (int i = 0; i < REGIONS; i++)
+			if (fences[i])
+			{
+				glClientWaitSync(fences[i], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+				glDeleteSync(fences[i]);
+				fences[i] = 0;
+			}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		glDeleteBuffers(1, &buffer);
+		buffer = 0;
+		mapped = NULL;
+	}
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	unsigned char* mapped = NULL;
+	size_t regionSize = 0;
+	size_t uniformAlignment = 256;
+	size_t storageAlignment = 256;
+	int region = 0;
+	size_t head = 0;
+	GLsync fences[REGIONS] = {};
+	double lastStallMs = 0.0;
+	Stats stats;
+};
+#endif
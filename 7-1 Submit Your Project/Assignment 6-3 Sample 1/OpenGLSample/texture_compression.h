@@ -0,0 +1,358 @@
+#ifndef TEXTURE_COMPRESSION_H
+#define TEXTURE_COMPRESSION_H
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h" // declarations only, the implementation lives in Source.cpp
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Offline texture cooking: a source image is decoded once, a box-filtered mip chain is built on the CPU
+// and every level is block compressed into a DDS file next to the source. Opaque images become BC1
+// (DXT1, 4 bits per texel), images with alpha become BC3 (DXT5, 8 bits per texel). At run time the
+// blocks are read back and handed to glCompressedTexImage2D as they are, with no decode and no
+// driver-side mipmap generation. Rows are stored top-down exactly as decoded; shaders flip V.
+
+enum class BlockFormat
+{
+	BC1,
+	BC3
+};
+
+struct MipLevel
+{
+	int width, height;
+	size_t offset, size; // byte range of the level inside CompressedImage::data
+};
+
+struct CompressedImage
+{
+	BlockFormat format = BlockFormat::BC1;
+	int width = 0, height = 0;
+	std::vector<MipLevel> levels;
+	std::vector<unsigned char> data;
+};
+
+inline size_t BlockBytes(BlockFormat format)
+{
+	return format == BlockFormat::BC1 ? 8 : 16;
+}
+
+inline size_t CompressedLevelSize(BlockFormat format, int width, int height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+
+// the dds file that CookTexture writes for a source image, "textures/darkwood.jpg" -> "textures/darkwood.dds"
+inline std::string CookedTexturePath(const std::string& source)
+{
+	size_t dot = source.find_last_of('.');
+	size_t slash = source.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return source + ".dds";
+	return source.substr(0, dot) + ".dds";
+}
+
+// halves an RGBA8 image with a 2x2 box filter; odd edges reuse their last row or column
+inline std::vector<unsigned char> DownsampleRGBA(const std::vector<unsigned char>& source, int width, int height, int& outWidth, int& outHeight)
+{
+	outWidth = std::max(1, width / 2);
+	outHeight = std::max(1, height / 2);
+	std::vector<unsigned char> result((size_t)outWidth * outHeight * 4);
+	for (int y = 0; y < outHeight; y++)
+	{
+		int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+		for (int x = 0; x < outWidth; x++)
+		{
+			int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+			for (int c = 0; c < 4; c++)
+			{
+				unsigned int sum = source[((size_t)y0 * width + x0) * 4 + c] + source[((size_t)y0 * width + x1) * 4 + c]
+					+ source[((size_t)y1 * width + x0) * 4 + c] + source[((size_t)y1 * width + x1) * 4 + c];
+				result[((size_t)y * outWidth + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+			}
+		}
+	}
+	return result;
+}
+
+inline std::uint16_t PackColor565(const float* rgb)
+{
+	int r = std::min(31, std::max(0, (int)(rgb[0] * 31.0f / 255.0f + 0.5f)));
+	int g = std::min(63, std::max(0, (int)(rgb[1] * 63.0f / 255.0f + 0.5f)));
+	int b = std::min(31, std::max(0, (int)(rgb[2] * 31.0f / 255.0f + 0.5f)));
+	return (std::uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void UnpackColor565(std::uint16_t color, int* rgb)
+{
+	int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	rgb[0] = (r << 3) | (r >> 2);
+	rgb[1] = (g << 2) | (g >> 4);
+	rgb[2] = (b << 3) | (b >> 2);
+}
+
+// encodes the colors of a 4x4 RGBA block (64 bytes) into an 8 byte BC1 block. The endpoints are the
+// extremes of the block along its principal axis, pulled in by 1/16 of the range to cut the error of
+// the interpolated palette entries, and the colors always use the four color mode.
+inline void EncodeBC1Block(const unsigned char* pixels, unsigned char* block)
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+		for (int c = 0; c < 3; c++)
+			mean[c] += pixels[i * 4 + c] / 16.0f;
+	float covariance[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f }; // rr rg rb gg gb bb
+	for (int i = 0; i < 16; i++)
+	{
+		float r = pixels[i * 4] - mean[0], g = pixels[i * 4 + 1] - mean[1], b = pixels[i * 4 + 2] - mean[2];
+		covariance[0] += r * r;
+		covariance[1] += r * g;
+		covariance[2] += r * b;
+		covariance[3] += g * g;
+		covariance[4] += g * b;
+		covariance[5] += b * b;
+	}
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++) // power iteration towards the largest eigenvector
+	{
+		float next[3] = {
+			covariance[0] * axis[0] + covariance[1] * axis[1] + covariance[2] * axis[2],
+			covariance[1] * axis[0] + covariance[3] * axis[1] + covariance[4] * axis[2],
+			covariance[2] * axis[0] + covariance[4] * axis[1] + covariance[5] * axis[2] };
+		float largest = std::max(std::abs(next[0]), std::max(std::abs(next[1]), std::abs(next[2])));
+		if (largest < 1e-6f)
+			break; // flat block, any axis will do
+		for (int c = 0; c < 3; c++)
+			axis[c] = next[c] / largest;
+	}
+	float lowest = 1e30f, highest = -1e30f;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = (pixels[i * 4] - mean[0]) * axis[0] + (pixels[i * 4 + 1] - mean[1]) * axis[1] + (pixels[i * 4 + 2] - mean[2]) * axis[2];
+		lowest = std::min(lowest, t);
+		highest = std::max(highest, t);
+	}
+	float length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	float inset = (highest - lowest) / 16.0f;
+	float minColor[3], maxColor[3];
+	for (int c = 0; c < 3; c++)
+	{
+		minColor[c] = mean[c] + axis[c] * (lowest + inset) / length;
+		maxColor[c] = mean[c] + axis[c] * (highest - inset) / length;
+	}
+	std::uint16_t color0 = PackColor565(maxColor);
+	std::uint16_t color1 = PackColor565(minColor);
+	if (color0 < color1)
+		std::swap(color0, color1); // color0 > color1 selects the four color mode
+	int palette[4][3];
+	UnpackColor565(color0, palette[0]);
+	UnpackColor565(color1, palette[1]);
+	for (int c = 0; c < 3; c++)
+	{
+		palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+		palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+	}
+	std::uint32_t indices = 0;
+	if (color0 != color1)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, bestError = 1 << 30;
+			for (int p = 0; p < 4; p++)
+			{
+				int dr = pixels[i * 4] - palette[p][0], dg = pixels[i * 4 + 1] - palette[p][1], db = pixels[i * 4 + 2] - palette[p][2];
+				int error = dr * dr + dg * dg + db * db;
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (std::uint32_t)best << (i * 2);
+		}
+	}
+	block[0] = (unsigned char)(color0 & 0xFF);
+	block[1] = (unsigned char)(color0 >> 8);
+	block[2] = (unsigned char)(color1 & 0xFF);
+	block[3] = (unsigned char)(color1 >> 8);
+	for (int i = 0; i < 4; i++)
+		block[4 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+// encodes a 4x4 RGBA block into a 16 byte BC3 block: eight-value interpolated alpha, then BC1 colors
+inline void EncodeBC3Block(const unsigned char* pixels, unsigned char* block)
+{
+	int alpha0 = 0, alpha1 = 255;
+	for (int i = 0; i < 16; i++)
+	{
+		alpha0 = std::max(alpha0, (int)pixels[i * 4 + 3]);
+		alpha1 = std::min(alpha1, (int)pixels[i * 4 + 3]);
+	}
+	int palette[8] = { alpha0, alpha1 };
+	for (int p = 2; p < 8; p++) // alpha0 > alpha1 selects the eight value mode
+		palette[p] = ((8 - p) * alpha0 + (p - 1) * alpha1) / 7;
+	std::uint64_t indices = 0;
+	if (alpha0 != alpha1)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0, bestError = 256;
+			for (int p = 0; p < 8; p++)
+			{
+				int error = std::abs(pixels[i * 4 + 3] - palette[p]);
+				if (error < bestError)
+				{
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (std::uint64_t)best << (i * 3);
+		}
+	}
+	block[0] = (unsigned char)alpha0;
+	block[1] = (unsigned char)alpha1;
+	for (int i = 0; i < 6; i++)
+		block[2 + i] = (unsigned char)(indices >> (i * 8));
+	EncodeBC1Block(pixels, block + 8);
+}
+
+// compresses one RGBA8 level, edge blocks repeat the last row and column of the image
+inline void CompressLevel(const unsigned char* rgba, int width, int height, BlockFormat format, unsigned char* destination)
+{
+	unsigned char pixels[64];
+	for (int by = 0; by < height; by += 4)
+	{
+		for (int bx = 0; bx < width; bx += 4)
+		{
+			for (int y = 0; y < 4; y++)
+				for (int x = 0; x < 4; x++)
+					std::memcpy(&pixels[(y * 4 + x) * 4], &rgba[((size_t)std::min(by + y, height - 1) * width + std::min(bx + x, width - 1)) * 4], 4);
+			if (format == BlockFormat::BC1)
+				EncodeBC1Block(pixels, destination);
+			else
+				EncodeBC3Block(pixels, destination);
+			destination += BlockBytes(format);
+		}
+	}
+}
+
+// builds the full mip chain down to 1x1 and compresses every level
+inline CompressedImage CompressImage(const unsigned char* rgba, int width, int height, BlockFormat format)
+{
+	CompressedImage image;
+	image.format = format;
+	image.width = width;
+	image.height = height;
+	std::vector<unsigned char> level(rgba, rgba + (size_t)width * height * 4);
+	for (;;)
+	{
+		MipLevel mip;
+		mip.width = width;
+		mip.height = height;
+		mip.offset = image.data.size();
+		mip.size = CompressedLevelSize(format, width, height);
+		image.data.resize(mip.offset + mip.size);
+		CompressLevel(&level[0], width, height, format, &image.data[mip.offset]);
+		image.levels.push_back(mip);
+		if (width == 1 && height == 1)
+			break;
+		level = DownsampleRGBA(level, width, height, width, height);
+	}
+	return image;
+}
+
+// DDS container, legacy header with a DXT1/DXT5 FourCC
+// ------------------------------------------------------------------------
+const std::uint32_t DDS_MAGIC = 0x20534444; // "DDS "
+const std::uint32_t DDS_FOURCC_DXT1 = 0x31545844;
+const std::uint32_t DDS_FOURCC_DXT5 = 0x35545844;
+const int DDS_HEADER_WORDS = 32; // the magic followed by the 124 byte DDS_HEADER, block data starts at byte 128
+
+inline bool WriteDDS(const char* path, const CompressedImage& image)
+{
+	std::uint32_t header[DDS_HEADER_WORDS] = {};
+	header[0] = DDS_MAGIC;
+	header[1] = 124; // dwSize
+	header[2] = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+	header[3] = (std::uint32_t)image.height;
+	header[4] = (std::uint32_t)image.width;
+	header[5] = (std::uint32_t)image.levels[0].size; // dwPitchOrLinearSize
+	header[7] = (std::uint32_t)image.levels.size(); // dwMipMapCount
+	header[19] = 32; // DDS_PIXELFORMAT::dwSize
+	header[20] = 0x4; // DDPF_FOURCC
+	header[21] = image.format == BlockFormat::BC1 ? DDS_FOURCC_DXT1 : DDS_FOURCC_DXT5;
+	header[27] = 0x1000 | 0x8 | 0x400000; // DDSCAPS_TEXTURE | COMPLEX | MIPMAP
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)&image.data[0], image.data.size());
+	return (bool)file;
+}
+
+// reads a file written by WriteDDS (or any DXT1/DXT5 DDS with a plain 2D mip chain)
+inline bool ReadDDS(const char* path, CompressedImage& image)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	std::uint32_t header[DDS_HEADER_WORDS];
+	if (!file.read((char*)header, sizeof(header)) || header[0] != DDS_MAGIC || header[1] != 124 || !(header[20] & 0x4))
+		return false;
+	if (header[21] == DDS_FOURCC_DXT1)
+		image.format = BlockFormat::BC1;
+	else if (header[21] == DDS_FOURCC_DXT5)
+		image.format = BlockFormat::BC3;
+	else
+		return false;
+	image.height = (int)header[3];
+	image.width = (int)header[4];
+	int levelCount = std::max(1, (int)header[7]);
+	image.levels.clear();
+	size_t total = 0;
+	int width = image.width, height = image.height;
+	for (int i = 0; i < levelCount; i++)
+	{
+		MipLevel mip;
+		mip.width = width;
+		mip.height = height;
+		mip.offset = total;
+		mip.size = CompressedLevelSize(image.format, width, height);
+		total += mip.size;
+		image.levels.push_back(mip);
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	image.data.resize(total);
+	return (bool)file.read((char*)&image.data[0], total);
+}
+
+// decode a source image and write its compressed mip chain, returns false if either step fails
+inline bool CookTexture(const char* source, const char* destination, CompressedImage* cooked = NULL)
+{
+	int width, height, channels;
+	unsigned char* pixels = stbi_load(source, &width, &height, &channels, 4);
+	if (!pixels)
+		return false;
+	BlockFormat format = BlockFormat::BC1;
+	for (size_t i = 0; channels == 4 && i < (size_t)width * height; i++)
+	{
+		if (pixels[i * 4 + 3] != 255)
+		{
+			format = BlockFormat::BC3;
+			break;
+		}
+	}
+	CompressedImage image = CompressImage(pixels, width, height, format);
+	stbi_image_free(pixels);
+	if (cooked)
+		*cooked = image;
+	return WriteDDS(destination, image);
+}
+#endif
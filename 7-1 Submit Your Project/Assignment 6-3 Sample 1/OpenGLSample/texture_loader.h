@@ -0,0 +1,385 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#if !defined(__glew_h__) && !defined(__glad_h_)
+#include <glad/glad.h> // holds all OpenGL type declarations (Source.cpp pulls in GLEW instead)
+#endif
+
+#ifndef STBI_INCLUDE_STB_IMAGE_H
+#include "stb_image.h" // declarations only, the implementation lives in Source.cpp
+#endif
+#include "texture_compression.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT // EXT_texture_compression_s3tc, missing from core-only loaders
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it.
+// Only needed when the sampling side cannot flip the V coordinate itself; rows are swapped through a
+// small bounce buffer with memcpy, which the C runtime vectorizes, instead of one byte at a time.
+inline void flipImageVertically(unsigned char* image, int width, int height, int channels)
+{
+	const size_t rowSize = (size_t)width * channels;
+	unsigned char buffer[4096];
+	for (int j = 0; j < height / 2; ++j)
+	{
+		unsigned char* top = image + j * rowSize;
+		unsigned char* bottom = image + (height - 1 - j) * rowSize;
+		for (size_t done = 0; done < rowSize; done += sizeof(buffer))
+		{
+			size_t chunk = std::min(rowSize - done, sizeof(buffer));
+			std::memcpy(buffer, top + done, chunk);
+			std::memcpy(top + done, bottom + done, chunk);
+			std::memcpy(bottom + done, buffer, chunk);
+		}
+	}
+}
+
+// Asynchronous texture loader. Request() hands out a texture name right away, backed by a 1x1
+// placeholder; worker threads decode the file, and Pump() on the GL thread uploads finished images
+// through a persistently mapped pixel unpack buffer. Decoded images travel from the workers to the
+// GL thread through one lock-free single-producer/single-consumer ring per worker.
+// When a cooked .dds sits next to the requested file (see texture_compression.h), the worker reads its
+// blocks instead of decoding, and the upload is a straight glCompressedTexImage2D per mip level.
+class TextureLoader
+{
+public:
+	// spawn the decode workers and create the staging buffer, call on the GL thread
+	// ------------------------------------------------------------------------
+	void Start(unsigned int workerCount = 0, size_t stagingBytes = 32 * 1024 * 1024)
+	{
+		if (workerCount == 0)
+		{
+			unsigned int cores = std::thread::hardware_concurrency(); // 0 when the count is unknown
+			workerCount = cores > 1 ? cores - 1 : 1;
+		}
+		stopping = false;
+		rings.resize(workerCount);
+		for (unsigned int i = 0; i < workerCount; i++)
+			rings[i] = new ResultRing();
+		for (unsigned int i = 0; i < workerCount; i++)
+			workers.push_back(std::thread(&TextureLoader::WorkerMain, this, rings[i]));
+
+		stagingSize = stagingBytes;
+		glGenBuffers(1, &stagingBuffer);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, stagingSize, NULL, flags);
+		staging = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, stagingSize, flags);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		stagingHead = 0;
+	}
+	// join the workers and release everything that was not uploaded yet
+	// ------------------------------------------------------------------------
+	void Stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(jobsMutex);
+			stopping = true;
+			jobs.clear();
+		}
+		jobsReady.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+		workers.clear();
+		Decoded image;
+		for (size_t i = 0; i < rings.size(); i++)
+		{
+			while (rings[i]->Pop(image))
+				stbi_image_free(image.pixels);
+			delete rings[i];
+		}
+		rings.clear();
+		for (size_t i = 0; i < inFlight.size(); i++)
+			glDeleteSync(inFlight[i].fence);
+		inFlight.clear();
+		if (stagingBuffer)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glDeleteBuffers(1, &stagingBuffer);
+			stagingBuffer = 0;
+			staging = NULL;
+		}
+	}
+	// create the texture with placeholder contents and queue the decode, call on the GL thread.
+	// Pass flipVertically = false when the shader samples with V pointing down, which costs nothing.
+	// ------------------------------------------------------------------------
+	GLuint Request(const char* filename, bool flipVertically = true)
+	{
+		GLuint textureId = 0;
+		glGenTextures(1, &textureId);
+		glBindTexture(GL_TEXTURE_2D, textureId);
+		// set the texture wrapping parameters
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		// set texture filtering parameters; the placeholder has one level, Upload() turns on mipmapped minification with the real chain
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		const unsigned char placeholder[4] = { 128, 128, 128, 255 }; // mid grey until the real image lands
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		{
+			std::lock_guard<std::mutex> lock(jobsMutex);
+			Job job;
+			job.textureId = textureId;
+			job.filename = filename;
+			job.flipVertically = flipVertically;
+			jobs.push_back(job);
+			pending++;
+		}
+		jobsReady.notify_one();
+		return textureId;
+	}
+	// upload up to maxUploads finished images, call once per frame on the GL thread.
+	// Returns the number of textures replaced; texture bindings are clobbered when it is non-zero.
+	// ------------------------------------------------------------------------
+	unsigned int Pump(unsigned int maxUploads = 2)
+	{
+		TRACE_ZONE("TextureLoader::Pump");
+		unsigned int uploads = 0;
+		Decoded image;
+		for (size_t i = 0; i < rings.size() && uploads < maxUploads; i++)
+		{
+			while (uploads < maxUploads && rings[i]->Pop(image))
+			{
+				Upload(image);
+				stbi_image_free(image.pixels);
+				pending--;
+				uploads++;
+			}
+		}
+		return uploads;
+	}
+	// number of requested textures that have not been uploaded yet
+	// ------------------------------------------------------------------------
+	int Pending() const
+	{
+		return pending;
+	}
+
+private:
+	struct Job
+	{
+		GLuint textureId;
+		std::string filename;
+		bool flipVertically;
+	};
+	struct Decoded
+	{
+		GLuint textureId;
+		std::string filename;
+		unsigned char* pixels; // stb_image output, NULL when the texture came from a cooked file
+		int width, height, channels;
+		CompressedImage compressed;
+	};
+	// fixed-capacity ring written by one worker and read by the GL thread, no locks on either side
+	struct ResultRing
+	{
+		static const size_t CAPACITY = 16;
+		Decoded slots[CAPACITY];
+		std::atomic<size_t> head{ 0 }; // next slot to read, owned by the consumer
+		std::atomic<size_t> tail{ 0 }; // next slot to write, owned by the producer
+
+		bool Push(Decoded& image)
+		{
+			size_t t = tail.load(std::memory_order_relaxed);
+			if (t - head.load(std::memory_order_acquire) == CAPACITY)
+				return false;
+			slots[t % CAPACITY] = std::move(image);
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+		bool Pop(Decoded& image)
+		{
+			size_t h = head.load(std::memory_order_relaxed);
+			if (h == tail.load(std::memory_order_acquire))
+				return false;
+			image = std::move(slots[h % CAPACITY]);
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+	};
+	// a staging range the GPU may still be reading from
+	struct StagingRange
+	{
+		size_t begin, end;
+		GLsync fence;
+	};
+
+	std::vector<std::thread> workers;
+	std::vector<ResultRing*> rings;
+	std::mutex jobsMutex;
+	std::condition_variable jobsReady;
+	std::deque<Job> jobs;
+	std::atomic<bool> stopping{ false }; // workers also read it outside jobsMutex, between decodes
+	int pending = 0;
+
+	GLuint stagingBuffer = 0;
+	unsigned char* staging = NULL;
+	size_t stagingSize = 0;
+	size_t stagingHead = 0;
+	std::deque<StagingRange> inFlight;
+
+	void WorkerMain(ResultRing* ring)
+	{
+		stbi_set_flip_vertically_on_load_thread(0); // orientation is decided per request, never by stb's global flag
+		TRACE_THREAD_NAME("texture worker");
+		for (;;)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(jobsMutex);
+				jobsReady.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (stopping)
+					return;
+				job = jobs.front();
+				jobs.pop_front();
+			}
+			TRACE_ZONE("TextureLoader::Decode");
+			Decoded image;
+			image.textureId = job.textureId;
+			image.filename = job.filename;
+			image.pixels = NULL;
+			// cooked blocks are stored top-down, so only unflipped requests can use them
+			if (job.flipVertically || !ReadDDS(CookedTexturePath(job.filename).c_str(), image.compressed))
+			{
+				image.compressed = CompressedImage();
+				image.pixels = stbi_load(job.filename.c_str(), &image.width, &image.height, &image.channels, 0);
+			}
+			if (image.pixels && job.flipVertically)
+				flipImageVertically(image.pixels, image.width, image.height, image.channels);
+			while (!ring->Push(image)) // the GL thread is behind, wait for it to drain a slot
+			{
+				if (stopping)
+				{
+					stbi_image_free(image.pixels);
+					return;
+				}
+				std::this_thread::yield();
+			}
+		}
+	}
+	// reserve size bytes of the staging buffer, waiting for the GPU only if it still reads that range
+	unsigned char* AllocateStaging(size_t size, size_t& offset)
+	{
+		if (!staging || size > stagingSize)
+			return NULL;
+		if (stagingHead + size > stagingSize)
+			stagingHead = 0;
+		offset = stagingHead;
+		// fences signal in order, so waiting on the newest overlapping range retires every older one
+		size_t retire = 0;
+		for (size_t i = 0; i < inFlight.size(); i++)
+			if (inFlight[i].begin < offset + size && offset < inFlight[i].end)
+				retire = i + 1;
+		if (retire > 0)
+			glClientWaitSync(inFlight[retire - 1].fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+		for (size_t i = 0; i < retire; i++)
+		{
+			glDeleteSync(inFlight.front().fence);
+			inFlight.pop_front();
+		}
+		stagingHead += size;
+		return staging + offset;
+	}
+	void UploadCompressed(const Decoded& image)
+	{
+		const CompressedImage& source = image.compressed;
+		GLenum format = source.format == BlockFormat::BC1 ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		size_t offset = 0;
+		unsigned char* destination = AllocateStaging(source.data.size(), offset);
+		glBindTexture(GL_TEXTURE_2D, image.textureId);
+		if (destination)
+		{
+			std::memcpy(destination, &source.data[0], source.data.size());
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+		}
+		for (size_t i = 0; i < source.levels.size(); i++)
+		{
+			const MipLevel& level = source.levels[i];
+			const void* data = destination ? (const void*)(offset + level.offset) : (const void*)&source.data[level.offset];
+			glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, format, level.width, level.height, 0, (GLsizei)level.size, data);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)source.levels.size() - 1); // the chain is precomputed, no glGenerateMipmap
+		if (source.levels.size() > 1) // sample the chain, not only level 0
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		if (destination)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			StagingRange range;
+			range.begin = offset;
+			range.end = offset + source.data.size();
+			range.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			inFlight.push_back(range);
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+	void Upload(const Decoded& image)
+	{
+		if (!image.compressed.levels.empty())
+		{
+			UploadCompressed(image);
+			return;
+		}
+		if (!image.pixels)
+		{
+			std::cout << "Failed to load texture " << image.filename << std::endl;
+			return;
+		}
+		GLenum internalFormat, format;
+		if (image.channels == 3)
+		{
+			internalFormat = GL_RGB8;
+			format = GL_RGB;
+		}
+		else if (image.channels == 4)
+		{
+			internalFormat = GL_RGBA8;
+			format = GL_RGBA;
+		}
+		else
+		{
+			std::cout << "Not implemented to handle image with " << image.channels << " channels" << std::endl;
+			return;
+		}
+		size_t size = (size_t)image.width * image.height * image.channels;
+		size_t offset = 0;
+		unsigned char* destination = AllocateStaging(size, offset);
+		glBindTexture(GL_TEXTURE_2D, image.textureId);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // RGB rows are not always a multiple of 4 bytes
+		if (destination)
+		{
+			std::memcpy(destination, image.pixels, size);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stagingBuffer);
+			glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, (void*)offset);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			StagingRange range;
+			range.begin = offset;
+			range.end = offset + size;
+			range.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			inFlight.push_back(range);
+		}
+		else // larger than the whole staging buffer, upload straight from client memory
+			glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+};
+#endif
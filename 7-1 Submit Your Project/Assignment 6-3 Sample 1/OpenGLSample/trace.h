@@ -0,0 +1,194 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// Scoped CPU instrumentation that exports to the Chrome trace event format (chrome://tracing, Perfetto).
+//   TRACE_ZONE("name");        times the rest of the enclosing scope, pass a string literal
+//   TRACE_THREAD_NAME("name"); labels the calling thread's track
+//   TRACE_DUMP("trace.json");  writes every recorded zone of every thread, returns false on failure
+// Unless ENABLE_TRACE is defined (the Debug configurations define it) all three expand to nothing,
+// so release builds pay no cost at all. When enabled, each thread appends to its own fixed-size ring,
+// so recording takes no lock; the oldest zones are overwritten once a ring is full.
+
+#ifdef ENABLE_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace trace
+{
+	struct Event
+	{
+		const char* name;
+		std::uint64_t start; // nanoseconds since Epoch()
+		std::uint64_t duration;
+	};
+
+	// One ring entry, a seqlock: sequence is 0 while the owner writes the slot and the event's index + 1
+	// once it is complete. Dump() keeps a copy only if the sequence matches before and after, so a slot
+	// the owner overwrites mid-read is skipped. The fields are relaxed atomics (plain moves on x86) to make
+	// that concurrent read defined.
+	struct Slot
+	{
+		std::atomic<std::uint64_t> sequence{ 0 };
+		std::atomic<const char*> name{ nullptr };
+		std::atomic<std::uint64_t> start{ 0 };
+		std::atomic<std::uint64_t> duration{ 0 };
+	};
+
+	// written by its owning thread only; the head is published with release so a reader sees whole events
+	struct ThreadBuffer
+	{
+		static const size_t CAPACITY = 1 << 16;
+		Slot events[CAPACITY];
+		std::atomic<std::uint64_t> head{ 0 };
+		std::string name; // guarded by the registry mutex: renamed by its thread, read by Dump() on any other
+		unsigned int id = 0;
+	};
+
+	inline std::chrono::steady_clock::time_point Epoch()
+	{
+		static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+		return epoch;
+	}
+
+	inline std::uint64_t Now()
+	{
+		return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - Epoch()).count();
+	}
+
+	// every thread's buffer, kept alive past thread exit so short-lived workers still show up in a dump
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+	};
+
+	inline Registry& GetRegistry()
+	{
+		static Registry registry;
+		return registry;
+	}
+
+	// the calling thread's buffer, registered on first use (the only time a lock is taken)
+	inline ThreadBuffer& LocalBuffer()
+	{
+		static thread_local ThreadBuffer* buffer = nullptr;
+		if (!buffer)
+		{
+			Registry& registry = GetRegistry();
+			std::lock_guard<std::mutex> lock(registry.mutex);
+			registry.buffers.push_back(std::unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+			buffer = registry.buffers.back().get();
+			buffer->id = (unsigned int)registry.buffers.size();
+			buffer->name = "thread " + std::to_string(buffer->id);
+		}
+		return *buffer;
+	}
+
+	inline void Record(const char* name, std::uint64_t start, std::uint64_t end)
+	{
+		ThreadBuffer& buffer = LocalBuffer();
+		std::uint64_t head = buffer.head.load(std::memory_order_relaxed);
+		Slot& slot = buffer.events[head % ThreadBuffer::CAPACITY];
+		slot.sequence.store(0, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release); // the reset is seen before any new field
+		slot.name.store(name, std::memory_order_relaxed);
+		slot.start.store(start, std::memory_order_relaxed);
+		slot.duration.store(end - start, std::memory_order_relaxed);
+		slot.sequence.store(head + 1, std::memory_order_release);
+		buffer.head.store(head + 1, std::memory_order_release);
+	}
+
+	inline void SetThreadName(const char* name)
+	{
+		ThreadBuffer& buffer = LocalBuffer();
+		std::lock_guard<std::mutex> lock(GetRegistry().mutex);
+		buffer.name = name;
+	}
+
+	class Zone
+	{
+	public:
+		explicit Zone(const char* zoneName) : name(zoneName), start(Now()) {}
+		~Zone()
+		{
+			Record(name, start, Now());
+		}
+		Zone(const Zone&) = delete;
+		Zone& operator=(const Zone&) = delete;
+
+	private:
+		const char* name;
+		std::uint64_t start;
+	};
+
+	inline void WriteEscaped(FILE* file, const std::string& text)
+	{
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			if (text[i] == '"' || text[i] == '\\')
+				std::fputc('\\', file);
+			std::fputc(text[i], file);
+		}
+	}
+
+	// Safe while other threads keep recording: a slot that is overwritten during the dump fails its
+	// sequence check and is left out, so a ring that wraps mid-dump loses its oldest zones, never tears one.
+	inline bool Dump(const char* path)
+	{
+		FILE* file = std::fopen(path, "w");
+		if (!file)
+			return false;
+		Registry& registry = GetRegistry();
+		std::lock_guard<std::mutex> lock(registry.mutex);
+		std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		bool first = true;
+		for (size_t b = 0; b < registry.buffers.size(); b++)
+		{
+			const ThreadBuffer& buffer = *registry.buffers[b];
+			std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", first ? "" : ",\n", buffer.id);
+			WriteEscaped(file, buffer.name);
+			std::fprintf(file, "\"}}");
+			first = false;
+			std::uint64_t head = buffer.head.load(std::memory_order_acquire);
+			std::uint64_t begin = head > ThreadBuffer::CAPACITY ? head - ThreadBuffer::CAPACITY : 0;
+			for (std::uint64_t i = begin; i < head; i++)
+			{
+				const Slot& slot = buffer.events[i % ThreadBuffer::CAPACITY];
+				std::uint64_t sequence = slot.sequence.load(std::memory_order_acquire);
+				if (sequence != i + 1)
+					continue; // already overwritten, or being written
+				Event event = { slot.name.load(std::memory_order_relaxed), slot.start.load(std::memory_order_relaxed), slot.duration.load(std::memory_order_relaxed) };
+				std::atomic_thread_fence(std::memory_order_acquire); // the copy is complete before the sequence is checked again
+				if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+					continue;
+				std::fprintf(file, ",\n{\"name\":\"");
+				WriteEscaped(file, event.name);
+				std::fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", buffer.id, event.start / 1000.0, event.duration / 1000.0);
+			}
+		}
+		std::fprintf(file, "\n]}\n");
+		return std::fclose(file) == 0;
+	}
+}
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_ZONE(name) trace::Zone TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) trace::SetThreadName(name)
+#define TRACE_DUMP(path) trace::Dump(path)
+
+#else
+
+#define TRACE_ZONE(name) ((void)0)
+#define TRACE_THREAD_NAME(name) ((void)0)
+#define TRACE_DUMP(path) false
+
+#endif
+#endif
@@ -0,0 +1,79 @@
+#ifndef UNIFORM_CACHE_H
+#define UNIFORM_CACHE_H
+
+#if !defined(__glew_h__) && !defined(__glad_h_)
+#include <glad/glad.h> // holds all OpenGL type declarations (Source.cpp pulls in GLEW instead)
+#endif
+
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+// Per-program uniform reflection cache. It is filled once after the program links by walking
+// GL_ACTIVE_UNIFORMS, so per-frame lookups never have to go back to the driver.
+class UniformCache
+{
+public:
+	// query every active uniform of a linked program and remember its location
+	// ------------------------------------------------------------------------
+	void Reflect(GLuint program)
+	{
+		locations.clear();
+		GLint count = 0;
+		GLint maxLength = 0;
+		glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::vector<GLchar> name(maxLength > 0 ? maxLength : 1);
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(program, (GLuint)i, (GLsizei)name.size(), &length, &size, &type, &name[0]);
+			std::string uniformName(&name[0], length);
+			GLint location = glGetUniformLocation(program, uniformName.c_str());
+			if (location < 0)
+				continue; // members of uniform blocks have no location
+			locations[uniformName] = location;
+			// arrays are reported as "name[0]", so also register the bare name and the other elements
+			const std::string suffix = "[0]";
+			if (uniformName.size() > suffix.size() && uniformName.compare(uniformName.size() - suffix.size(), suffix.size(), suffix) == 0)
+			{
+				std::string base = uniformName.substr(0, uniformName.size() - suffix.size());
+				locations[base] = location;
+				for (GLint element = 1; element < size; element++)
+				{
+					std::string elementName = base + "[" + std::to_string(element) + "]";
+					locations[elementName] = glGetUniformLocation(program, elementName.c_str());
+				}
+			}
+		}
+	}
+	// returns the cached location, or -1 like glGetUniformLocation when the uniform is not active
+	// ------------------------------------------------------------------------
+	GLint Location(const char* name) const
+	{
+		CallsSaved()++;
+		std::map<std::string, GLint, std::less<>>::const_iterator it = locations.find(name);
+		return it != locations.end() ? it->second : -1;
+	}
+	// number of glGetUniformLocation round-trips answered from a cache since the last call
+	// ------------------------------------------------------------------------
+	static unsigned int TakeCallsSaved()
+	{
+		unsigned int calls = CallsSaved();
+		CallsSaved() = 0;
+		return calls;
+	}
+
+private:
+	std::map<std::string, GLint, std::less<>> locations; // transparent comparator: lookups by const char* do not allocate
+
+	static unsigned int& CallsSaved()
+	{
+		static unsigned int calls = 0;
+		return calls;
+	}
+};
+#endif
@@ -0,0 +1,67 @@
+#ifndef VERTEX_PACKING_H
+#define VERTEX_PACKING_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+// Attribute encoders for compact vertex layouts. Every packed attribute is 32 bits:
+//   normal      octahedral encoding, 2 x snorm16   (GL_SHORT, normalized, decoded in the shader)
+//   texcoords   2 x half float                     (GL_HALF_FLOAT)
+//   tangent     xyz snorm10 + w sign for the bitangent (GL_INT_2_10_10_10_REV, normalized)
+// The matching GLSL decoder is
+//   vec3 octDecode(vec2 e)
+//   {
+//       vec3 v = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+//       if (v.z < 0.0) v.xy = (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+//       return normalize(v);
+//   }
+// and the bitangent is rebuilt as cross(normal, tangent.xyz) * tangent.w.
+
+// maps a unit vector onto the octahedron and unfolds it into the [-1, 1] square
+inline glm::vec2 OctEncode(const glm::vec3& n)
+{
+	glm::vec2 p = glm::vec2(n.x, n.y) * (1.0f / (glm::abs(n.x) + glm::abs(n.y) + glm::abs(n.z)));
+	if (n.z < 0.0f)
+	{
+		glm::vec2 signs(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+		p = (1.0f - glm::abs(glm::vec2(p.y, p.x))) * signs;
+	}
+	return p;
+}
+
+inline glm::vec3 OctDecode(const glm::vec2& e)
+{
+	glm::vec3 v(e.x, e.y, 1.0f - glm::abs(e.x) - glm::abs(e.y));
+	if (v.z < 0.0f)
+	{
+		glm::vec2 signs(v.x >= 0.0f ? 1.0f : -1.0f, v.y >= 0.0f ? 1.0f : -1.0f);
+		glm::vec2 folded = (1.0f - glm::abs(glm::vec2(v.y, v.x))) * signs;
+		v.x = folded.x;
+		v.y = folded.y;
+	}
+	return glm::normalize(v);
+}
+
+inline glm::uint32 PackNormal(const glm::vec3& normal)
+{
+	return glm::packSnorm2x16(OctEncode(normal));
+}
+
+inline glm::vec3 UnpackNormal(glm::uint32 packed)
+{
+	return OctDecode(glm::unpackSnorm2x16(packed));
+}
+
+inline glm::uint32 PackTexCoords(const glm::vec2& texCoords)
+{
+	return glm::packHalf2x16(texCoords);
+}
+
+// the bitangent is not stored, only which side of the normal/tangent plane it lies on
+inline glm::uint32 PackTangentFrame(const glm::vec3& normal, const glm::vec3& tangent, const glm::vec3& bitangent)
+{
+	float handedness = glm::dot(glm::cross(normal, tangent), bitangent) < 0.0f ? -1.0f : 1.0f;
+	glm::vec3 t = glm::length(tangent) > 0.0f ? glm::normalize(tangent) : glm::vec3(1.0f, 0.0f, 0.0f);
+	return glm::packSnorm3x10_1x2(glm::vec4(t, handedness));
+}
+#endif